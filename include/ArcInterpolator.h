@@ -0,0 +1,53 @@
+#ifndef ArcInterpolator_h
+#define ArcInterpolator_h
+
+#include <stdint.h>
+
+#include "MotionConfig.h"
+
+/*
+ * Breaks an arc in the XY plane (optionally a helix along Z) into straight chords.
+ *
+ * Chords are handed out one at a time by next() so the caller can feed them to the
+ * segment queue as room frees up instead of holding the whole arc in memory. The
+ * chord length comes from the chord tolerance, and each chord end is found by
+ * rotating the radius vector by a fixed angle, with an exact sin/cos correction
+ * every ARC_CORRECTION chords to stop rounding error from building up.
+ */
+class ArcInterpolator {
+public:
+    void setTolerance(float steps) { tolerance = steps; }
+
+    //Arc from start to end around a centre given as an offset from start, all in steps
+    void begin(const float start[AXIS_COUNT], const float end[AXIS_COUNT], float centreX, float centreY, bool clockwise);
+    //Arc from start to end with the given radius. A negative radius takes the long way around.
+    void beginRadius(const float start[AXIS_COUNT], const float end[AXIS_COUNT], float radius, bool clockwise);
+
+    //Centre offset from start for an arc of the given radius, see beginRadius()
+    static void centreFromRadius(const float start[AXIS_COUNT], const float end[AXIS_COUNT], float radius, bool clockwise, float &centreX, float &centreY);
+
+    //Get the end of the next chord, returns false once the arc is done
+    bool next(int32_t target[AXIS_COUNT]);
+
+    bool isActive() { return remaining > 0; }
+    void cancel() { remaining = 0; }
+
+private:
+    float tolerance = ARC_TOLERANCE;
+
+    float centre[2] = {0};
+    float radius = 0;
+    float radiusVector[2] = {0}; //From the centre to the last chord end
+    float startAngle = 0;
+    float angle = 0;             //Signed angle per chord
+    float cosAngle = 1;
+    float sinAngle = 0;
+    float zStep = 0;
+    float z = 0;
+    float end[AXIS_COUNT] = {0};
+
+    uint32_t chords = 0;
+    uint32_t remaining = 0;
+};
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef GCodeInterpreter_h
+#define GCodeInterpreter_h
+
+#include <stdint.h>
+
+#include "MotionConfig.h"
+
+//Longest line we'll buffer, anything longer is rejected
+#define GCODE_LINE_LENGTH 96
+
+//Most G words we'll take on one line, e.g. "G90 G1 X10"
+#define GCODE_MAX_G_WORDS 4
+
+enum GCodeStatus {
+    GCODE_INCOMPLETE,        //Still collecting the line, or nothing was pending
+    GCODE_PENDING,           //Line parsed but the machine can't take it yet, keep calling poll()
+    GCODE_OK,
+    GCODE_ERROR_CHECKSUM,    //Ask the host to resend
+    GCODE_ERROR_LINE_NUMBER, //Ask the host to resend
+    GCODE_ERROR_OVERFLOW,
+    GCODE_ERROR_SYNTAX,
+    GCODE_ERROR_UNSUPPORTED
+};
+
+/*
+ * What the interpreter drives. Every call returns false if the machine can't
+ * take the command right now (e.g. the motion queue is full), and will be
+ * repeated until it returns true.
+ */
+class GCodeMachine {
+public:
+    //Where the queued moves will leave the axis
+    virtual float getPosition(uint8_t axis) = 0;
+    //feedRate is along the path in units/s, 0 for a rapid
+    virtual bool line(const float target[AXIS_COUNT], float feedRate) = 0;
+    //Centre is an offset from the current position
+    virtual bool arc(const float target[AXIS_COUNT], float centreX, float centreY, bool clockwise, float feedRate) = 0;
+    virtual bool home() = 0;
+    //Everything not handled by the interpreter itself, hasS says if an S word was given
+    virtual bool mCode(uint16_t code, bool hasS, float s) = 0;
+};
+
+/*
+ * Streaming G-code interpreter.
+ *
+ * Bytes are fed in one at a time and collected into a fixed line buffer, so
+ * nothing is allocated. Supports G0/G1/G2/G3/G28/G90/G91, M110 plus whatever
+ * M-codes the machine handles, and Marlin style "N<line> ... *<checksum>"
+ * framing. A line is either a G-code/motion or an M-code, not both.
+ * Coordinates are in whatever units the machine works in.
+ */
+class GCodeInterpreter {
+public:
+    explicit GCodeInterpreter(GCodeMachine &machine) : machine(machine) {}
+
+    //Add one byte, returns the line's status once a newline completes it
+    GCodeStatus feed(char c);
+
+    //Retry a line the machine wasn't ready for. Don't feed() more until this stops returning GCODE_PENDING.
+    GCodeStatus poll();
+
+    //Last line number accepted, resend requests should ask for the one after
+    int32_t getLineNumber() { return lineNumber; }
+    uint32_t getLinesProcessed() { return linesProcessed; }
+
+private:
+    struct Words {
+        uint32_t seen = 0;      //Bit per letter, A = bit 0
+        float values[26] = {0};
+        uint8_t gCodes[GCODE_MAX_G_WORDS] = {0};
+        uint8_t gCount = 0;
+
+        bool has(char letter) { return seen & (1UL << (letter - 'A')); }
+        float get(char letter) { return values[letter - 'A']; }
+    };
+
+    GCodeStatus parseLine();
+    GCodeStatus execute();
+
+    GCodeMachine &machine;
+
+    char line[GCODE_LINE_LENGTH + 1];
+    uint8_t length = 0;
+    bool overflow = false;
+
+    Words words;
+    bool pending = false;
+
+    bool relative = false;    //G91
+    uint8_t motionMode = 0;   //Last G0-G3, applied to lines with only coordinates
+    float feedRate = 0;       //units/s
+
+    int32_t lineNumber = 0;
+    uint32_t linesProcessed = 0;
+};
+
+#endif
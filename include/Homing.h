@@ -0,0 +1,97 @@
+#ifndef Homing_h
+#define Homing_h
+
+#include <Arduino.h>
+#include <Adafruit_MCP23X17.h>
+
+#include "MotionConfig.h"
+
+//ESP32 pin the MCP's INTA/INTB is wired to. The MCP drives it, so input only pins are fine.
+#define HOMING_INTERRUPT_PIN 37
+
+//The slow approach runs this many times slower than the fast one
+#define HOMING_SLOW_FACTOR 4
+
+//Steps to back off a switch after touching it, has to be enough to release it
+#define HOMING_BACKOFF_STEPS 24
+
+//Slow touches per switch, the spread between them is the repeatability we report
+#define HOMING_TOUCHES 2
+
+//Give up on an axis that gets this many steps past where it started without hitting its switch
+#define HOMING_MAX_STEPS 100000
+
+//How close, in steps, a fast start runs up to the min switches before touching them
+#define HOMING_VERIFY_MARGIN 50
+//How far, in steps, a fast start's touch may be from where the cache says before we recalibrate
+#define HOMING_VERIFY_TOLERANCE 4
+
+/*
+ * Runs every axis onto its limit switch at once.
+ *
+ * Each axis makes a fast approach, backs off, then touches the switch again
+ * HOMING_TOUCHES times at a slow speed. The switches sit on the MCP, which is
+ * set up to raise its interrupt while an armed switch is closed. The switch
+ * pins are only read over I2C once that interrupt has fired, rather than
+ * once per step.
+ *
+ * Steps are emitted through the same callback the scheduler uses, so the
+ * scheduler has to be idle while homing runs.
+ */
+class Homing {
+public:
+    //Same as the scheduler's, false if the motor only woke its coils and the step is still owed
+    typedef bool (*StepCallback)(uint8_t axis, bool forward);
+
+    void begin(Adafruit_MCP23X17 &mcp, uint8_t interruptPin, StepCallback onStep);
+
+    //Switches are active low MCP pins. stepInterval is the fast approach's us per step.
+    void setAxis(uint8_t axis, uint8_t minPin, uint8_t maxPin, uint32_t stepInterval);
+
+    //Run every axis to its min or max switch. Returns false if any axis got more than maxSteps
+    //towards it without finding it. Backing off between touches doesn't count against that.
+    bool run(bool toMax, uint32_t maxSteps = HOMING_MAX_STEPS);
+
+    //Steps from where the last run started to the final touch on the switch
+    int32_t getPosition(uint8_t axis) { return axes[axis].position; }
+    //Spread of the slow touches, in steps
+    int32_t getSpread(uint8_t axis) { return axes[axis].spread; }
+    //How long the last run took, in ms
+    uint32_t getDuration() { return duration; }
+
+private:
+    enum Phase {
+        PHASE_FAST,
+        PHASE_BACK_OFF,
+        PHASE_SLOW,
+        PHASE_DONE,
+        PHASE_FAILED
+    };
+
+    struct Axis {
+        uint8_t pins[2] = {0};
+        uint32_t interval = 0;
+        Phase phase = PHASE_DONE;
+        uint8_t pin = 0;           //Switch the current run is headed for
+        bool forward = false;      //Direction of the switch
+        uint32_t nextStep = 0;
+        uint32_t backOff = 0;      //Steps left to back off
+        int32_t position = 0;
+        int32_t firstTouch = 0;
+        int32_t spread = 0;
+        uint8_t touches = 0;
+    };
+
+    void arm(Axis &axis, Phase phase, uint32_t now);
+    void touched(Axis &axis, uint32_t now);
+    void step(uint8_t index, bool forward, uint32_t now);
+
+    Adafruit_MCP23X17 *mcp = nullptr;
+    uint8_t interruptPin = 0;
+    StepCallback onStep = nullptr;
+    Axis axes[AXIS_COUNT];
+    uint32_t maxSteps = HOMING_MAX_STEPS;
+    uint32_t duration = 0;
+};
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef InputShaper_h
+#define InputShaper_h
+
+#include <stdint.h>
+
+//Ticks of position history kept per shaped axis, the longest shaper has to fit in it.
+//At a 100us tick that's 51.2ms, enough for ZVD down to about 20Hz.
+#define SHAPER_HISTORY 512
+
+//Most impulses any of the shapers use
+#define SHAPER_MAX_IMPULSES 3
+
+enum ShaperType {
+    SHAPER_NONE,
+    SHAPER_ZV,  //Shortest, only cancels right at the frequency
+    SHAPER_ZVD, //Twice as long as ZV, tolerates the frequency being off
+    SHAPER_MZV  //Between the two
+};
+
+/*
+ * Input shaping for one axis.
+ *
+ * The planned position is convolved with a few impulses, spaced and weighted so
+ * the ringing each one sets off in the frame cancels the others out at the given
+ * frequency. It runs one tick at a time off a fixed ring of past positions, so
+ * the cost per tick is one multiply and add per impulse.
+ *
+ * Weights are Q16 and always sum to exactly 1, so a position that's been held
+ * for the length of the shaper comes back out unchanged.
+ */
+class InputShaper {
+public:
+    //frequency in Hz and damping ratio of the ringing, tickUs is how often shape() is called.
+    //Returns false, and shapes nothing, if the shaper is longer than SHAPER_HISTORY ticks.
+    bool configure(ShaperType type, float frequency, float damping, uint32_t tickUs);
+
+    bool isEnabled() { return impulses > 1; }
+
+    //Forget the history, as if the axis had always been at position
+    void reset(int32_t position);
+
+    //Record where the axis is planned to be this tick and get where it should be
+    int32_t shape(int32_t position);
+
+    //True once the history is all the same position, the output has caught up with it
+    bool isSettled() { return settle == 0; }
+
+private:
+    int32_t history[SHAPER_HISTORY];
+    uint16_t head = 0;     //Where the next tick's position goes
+    uint16_t settle = 0;   //Ticks until the last change has passed every impulse
+
+    uint8_t impulses = 0;
+    uint16_t delays[SHAPER_MAX_IMPULSES] = {0};     //In ticks
+    uint32_t amplitudes[SHAPER_MAX_IMPULSES] = {0}; //Q16
+};
+
+#endif
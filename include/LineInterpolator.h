@@ -0,0 +1,40 @@
+#ifndef LineInterpolator_h
+#define LineInterpolator_h
+
+#include <stdint.h>
+
+#include "MotionConfig.h"
+
+/*
+ * Integer DDA (multi-axis Bresenham) for straight moves.
+ *
+ * The axis with the most steps (the major axis) steps on every event and the
+ * others step whenever their error term wraps, which spreads their steps
+ * evenly along the line. Only adds and compares are used per event, and the
+ * total steps per axis always match the requested delta exactly.
+ */
+class LineInterpolator {
+public:
+    //Set up a line of delta[] steps from the current position
+    void begin(const int32_t delta[AXIS_COUNT]);
+
+    //Advance one event, returns a bitmask of the axis that step on it
+    uint8_t next();
+
+    bool isDone() { return remaining == 0; }
+    bool moves(uint8_t axis) { return counts[axis] > 0; }
+
+    uint32_t getEvents() { return events; }
+    uint32_t getCount(uint8_t axis) { return counts[axis]; }
+    uint32_t getRemaining() { return remaining; }
+    uint8_t getForwardMask() { return forwardMask; }
+
+private:
+    uint32_t counts[AXIS_COUNT] = {0};
+    int32_t errors[AXIS_COUNT] = {0};
+    uint32_t events = 0;
+    uint32_t remaining = 0;
+    uint8_t forwardMask = 0;
+};
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef MotionConfig_h
+#define MotionConfig_h
+
+//X, Y and Z
+#define AXIS_COUNT 3
+
+//How many moves can be queued ahead of the one being stepped
+#define SEGMENT_QUEUE_SIZE 16
+
+//Default for how far, in steps, the path may cut a corner when blending two segments
+#define JUNCTION_DEVIATION 1.0f
+
+//Default for how far, in steps, an arc's chords may stray from the true arc
+#define ARC_TOLERANCE 0.5f
+
+//Default for how far, in steps, a merged move may stray from the ends of the moves it replaces
+#define MERGE_TOLERANCE 0.5f
+
+//Most moves merged into one, bounds the memory and the work of checking a merge
+#define MERGE_MAX_MOVES 8
+
+enum ProfileMode {
+    PROFILE_TRAPEZOID,
+    PROFILE_SCURVE //Jerk limited, needs a jerk limit on every moving axis
+};
+
+#endif
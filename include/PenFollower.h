@@ -0,0 +1,68 @@
+#ifndef PenFollower_h
+#define PenFollower_h
+
+#include <stdint.h>
+
+//XY mm/s the M3 S pen speed is given for, the feed scales with the head's speed from there
+#define PEN_NOMINAL_FEED 20
+//XY mm/s below which a synced pen stops feeding, so it doesn't blob where the head stops
+#define PEN_MIN_FEED 0.5f
+//Default for how far ahead, in ms, a synced pen starts retracting before travel and priming
+//before extruding. The filament lags the motor by about this much. It's also how long it retracts for.
+#define PEN_LEAD_TIME 300
+//Default pressure advance, in s. The feed runs ahead by this times the head's acceleration.
+#define PEN_ADVANCE 0.05f
+
+enum PenAction {
+    PEN_HOLD,    //Neither feeding nor retracting
+    PEN_FEED,    //Feed at getSpeed(), with the motor only driven if isGated()
+    PEN_RETRACT
+};
+
+/*
+ * Decides what a pen synced to the moves should be doing.
+ *
+ * It's handed the head's speed and the tool state of the line being stepped,
+ * and how long until that changes. Because the filament lags the motor, any
+ * change due within the lead time is acted on straight away: the pen primes
+ * ahead of a line that extrudes and pulls back ahead of travel, once, for the
+ * lead time. While extruding the feed follows the head's speed, run ahead by
+ * the pressure advance.
+ *
+ * Only decides, driving the pen's motor and servo is up to the caller.
+ */
+class PenFollower {
+public:
+    uint32_t leadTime = PEN_LEAD_TIME; //ms
+    float advance = PEN_ADVANCE;       //s
+    float flow = 90.0f / PEN_NOMINAL_FEED; //Servo speed per XY mm/s
+
+    //Start over from a pen that hasn't fed, e.g. when it's first synced
+    void reset();
+
+    //How far ahead, in us, to look for the tool changing. Longer than the lead time so
+    //a change right at the lead time is still seen coming.
+    uint32_t getHorizon() { return 2 * leadTime * 1000; }
+
+    //Call regularly with the time in ms, the head's XY speed in mm/s, whether the line being
+    //stepped extrudes, and how long in us until that changes, UINT32_MAX if not within getHorizon()
+    PenAction follow(uint32_t now, float velocity, bool toolOn, uint32_t untilChange);
+
+    float getSpeed() { return speed; }
+    bool isGated() { return gated; }
+
+    //Nothing has been fed that still needs pulling back
+    bool isSettled() { return !primed && !retracting; }
+
+private:
+    float speed = 0;
+    bool gated = false;
+    bool primed = false;     //Fed since last retracting
+    bool retracting = false;
+    uint32_t retractStarted = 0;
+    float lastVelocity = 0;
+    uint32_t lastFollow = 0;
+    bool followed = false;   //lastFollow and lastVelocity hold a sample
+};
+
+#endif
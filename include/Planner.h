@@ -0,0 +1,50 @@
+#ifndef Planner_h
+#define Planner_h
+
+#include <stdint.h>
+
+#include "MotionConfig.h"
+#include "SegmentQueue.h"
+
+/*
+ * Look-ahead velocity planner for the segment queue.
+ *
+ * Every new segment gets a junction speed limit from the angle it makes with
+ * the previous one (junction deviation), then a backward pass works out how
+ * fast each segment can be entered and still stop by the end of the queue, and
+ * a forward pass caps that by what acceleration can reach. Segments that can't
+ * improve any further are remembered so each pass only covers the new tail.
+ *
+ * The first queued segment's entry speed is never changed, the segment being
+ * stepped has already committed to exiting at it.
+ */
+class Planner {
+public:
+    void setJunctionDeviation(float steps) { junctionDeviation = steps; }
+
+    //Fill in the planner fields of a segment that's about to be queued
+    void prepare(Segment &segment, bool queueEmpty);
+
+    //Replan the queue after a push
+    void recalculate(SegmentQueue &queue);
+
+    //The scheduler popped the first segment
+    void onPop();
+
+    //Forget the previous segment, the next one starts from standstill
+    void reset();
+
+private:
+    //Acceleration along the path the planner can count on for this segment
+    float pathAcceleration(const Segment &segment);
+
+    float junctionDeviation = JUNCTION_DEVIATION;
+
+    bool hasPrevious = false;
+    float previousUnit[AXIS_COUNT] = {0};
+    float previousSpeedSqr = 0;
+
+    uint8_t planned = 0; //Queue index before which nothing can be improved
+};
+
+#endif
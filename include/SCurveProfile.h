@@ -0,0 +1,56 @@
+#ifndef SCurveProfile_h
+#define SCurveProfile_h
+
+#include <stdint.h>
+
+/*
+ * Jerk limited (S-curve) step timing.
+ *
+ * Acceleration ramps up at a fixed jerk, holds, then ramps back down as we
+ * approach cruise speed, and deceleration mirrors it. The velocity curve is
+ * evaluated in closed form against the time spent in the ramp, so each step is
+ * a few compares and multiplies plus one divide, the same order as the
+ * trapezoid. Anything involving sqrt/cbrt happens once per move in begin().
+ */
+class SCurveProfile {
+public:
+    //Plan a move of the given steps, velocities in steps/s, acceleration in steps/s^2, jerk in steps/s^3.
+    //If the move is too short to get from the entry to the exit velocity we end up above the exit velocity.
+    void begin(uint32_t steps, float entryVelocity, float maxVelocity, float exitVelocity, float acceleration, float jerk);
+
+    //Returns the us to wait before the next step
+    uint32_t next();
+
+    uint32_t getAccelSteps() { return accelSteps; }
+    uint32_t getDecelSteps() { return decelSteps; }
+
+private:
+    //One jerk limited change of velocity
+    struct Ramp {
+        float change = 0;           //Velocity gained over the ramp
+        float jerkTime = 0;         //Time spent ramping acceleration up (and again down)
+        float constantTime = 0;     //Time spent at peak acceleration
+        float peakAcceleration = 0;
+        float time = 0;             //Total time of the ramp
+
+        void plan(float change, float acceleration, float jerk);
+        float velocityAt(float t, float jerk);
+    };
+
+    float jerk = 0;
+    float entryVelocity = 0;
+    float cruiseVelocity = 0;
+    float exitVelocity = 0;
+    Ramp accelRamp;
+    Ramp decelRamp;
+    float rampInterval = 0;   //Longest step the ramps may take, in s
+
+    float time = 0;           //Where we are on the current ramp, in s. Runs backwards while decelerating
+    bool decelerating = false;
+    uint32_t step = 0;
+    uint32_t total = 0;
+    uint32_t accelSteps = 0;
+    uint32_t decelSteps = 0;
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef SegmentMerger_h
+#define SegmentMerger_h
+
+#include <stdint.h>
+
+#include "MotionConfig.h"
+
+/*
+ * Joins runs of nearly collinear moves into one before they're queued.
+ *
+ * The last move is held back rather than queued straight away. A following move
+ * at the same feed rate is folded into it if the straight line from the held
+ * move's start to the new end passes within the tolerance of every end it would
+ * replace, and it doesn't double back. Only the ends of the moves being merged
+ * are kept, up to MERGE_MAX_MOVES of them.
+ *
+ * Targets are absolute steps, so a move shorter than a step rounds onto the end
+ * it started from and its fraction carries over into whatever comes next. Those
+ * are dropped without ever taking a queue slot.
+ */
+class SegmentMerger {
+public:
+    void setTolerance(float steps) { tolerance = steps; }
+
+    //Offer a move to target, in steps, at feedRate. from is where it starts, only used if nothing
+    //is held. Returns false if it can't join the held move, take() that and offer it again.
+    bool add(const int32_t from[AXIS_COUNT], const int32_t target[AXIS_COUNT], float feedRate);
+
+    //Hand over the held move to be queued, returns false if nothing is held
+    bool take(int32_t target[AXIS_COUNT], float &feedRate);
+
+    //Forget the held move without queueing it
+    void cancel() { held = 0; }
+
+    bool isHolding() { return held > 0; }
+    int32_t getEnd(uint8_t axis) { return ends[held - 1][axis]; }
+
+    //Moves joined into the one before them, and moves under a step that were dropped
+    uint32_t getMerged() { return merged; }
+    uint32_t getFolded() { return folded; }
+
+private:
+    bool fits(const int32_t target[AXIS_COUNT]);
+
+    float tolerance = MERGE_TOLERANCE;
+
+    int32_t start[AXIS_COUNT] = {0};
+    int32_t ends[MERGE_MAX_MOVES][AXIS_COUNT]; //End of every held move, the last is where it's headed
+    uint8_t held = 0;
+    float feedRate = 0;
+
+    uint32_t merged = 0;
+    uint32_t folded = 0;
+};
+
+#endif
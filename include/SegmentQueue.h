@@ -0,0 +1,71 @@
+#ifndef SegmentQueue_h
+#define SegmentQueue_h
+
+#include <stdint.h>
+
+#include "MotionConfig.h"
+
+//A straight move waiting to be stepped. Limits are already scaled onto the major axis.
+struct Segment {
+    int32_t delta[AXIS_COUNT] = {0};
+    uint32_t events = 0;
+    float maxVelocity = 0;
+    float limitVelocity = 0;    //maxVelocity before the feed rate, as fast as an override may go
+    float acceleration = 0;
+    float jerk = 0;
+    ProfileMode mode = PROFILE_TRAPEZOID;
+    bool toolOn = false;        //The pen extrudes along this move
+
+    float length = 0;           //Length of the move, in steps
+
+    //Planner state. Speeds are along the path rather than the major axis, in steps/s.
+    float entrySpeedSqr = 0;
+    float maxEntrySpeedSqr = 0; //Junction limit with the segment before
+};
+
+/*
+ * Fixed capacity ring buffer of segments. Nothing is allocated, a full queue
+ * just refuses the push and it's up to the producer to retry.
+ *
+ * Not thread safe on its own, the scheduler guards it with its lock.
+ */
+class SegmentQueue {
+public:
+    bool push(const Segment &segment) {
+        if (isFull())
+            return false;
+
+        segments[head] = segment;
+        head = (head + 1) % SEGMENT_QUEUE_SIZE;
+        depth++;
+        return true;
+    }
+
+    bool pop(Segment &segment) {
+        if (isEmpty())
+            return false;
+
+        segment = segments[tail];
+        tail = (tail + 1) % SEGMENT_QUEUE_SIZE;
+        depth--;
+        return true;
+    }
+
+    //Queued segment by age, 0 is the next one to be stepped
+    Segment &at(uint8_t index) { return segments[(tail + index) % SEGMENT_QUEUE_SIZE]; }
+
+    void clear() { head = tail = depth = 0; }
+
+    bool isEmpty() { return depth == 0; }
+    bool isFull() { return depth == SEGMENT_QUEUE_SIZE; }
+    uint8_t getDepth() { return depth; }
+    uint8_t getFree() { return SEGMENT_QUEUE_SIZE - depth; }
+
+private:
+    Segment segments[SEGMENT_QUEUE_SIZE];
+    uint8_t head = 0;
+    uint8_t tail = 0;
+    uint8_t depth = 0;
+};
+
+#endif
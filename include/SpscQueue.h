@@ -0,0 +1,72 @@
+#ifndef SpscQueue_h
+#define SpscQueue_h
+
+#include <stdint.h>
+#include <atomic>
+
+/*
+ * Lock free ring buffer for passing items from exactly one producer task to
+ * exactly one consumer task, which may be on different cores.
+ *
+ * The producer only ever writes head and the consumer only ever writes tail,
+ * so neither side can block or be delayed by the other. An item is copied in
+ * before head is published, and read out before tail is, so the other side
+ * never sees a half written slot. One slot is always left empty to tell a
+ * full queue from an empty one, so it holds SIZE - 1 items.
+ */
+template <typename T, uint8_t SIZE>
+class SpscQueue {
+public:
+    //Producer side. A full queue refuses the push and it's up to the producer to retry.
+    bool push(const T &item) {
+        uint8_t head = this->head.load(std::memory_order_relaxed);
+        uint8_t next = (head + 1) % SIZE;
+        if (next == tail.load(std::memory_order_acquire))
+            return false;
+
+        items[head] = item;
+        this->head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool isFull() {
+        uint8_t next = (head.load(std::memory_order_relaxed) + 1) % SIZE;
+        return next == tail.load(std::memory_order_acquire);
+    }
+
+    //Consumer side. peek() leaves the item queued so it can be retried, null when empty.
+    T *peek() {
+        uint8_t tail = this->tail.load(std::memory_order_relaxed);
+        if (tail == head.load(std::memory_order_acquire))
+            return nullptr;
+
+        return &items[tail];
+    }
+
+    bool pop(T &item) {
+        T *next = peek();
+        if (next == nullptr)
+            return false;
+
+        item = *next;
+        drop();
+        return true;
+    }
+
+    //Drop the item peek() returned
+    void drop() {
+        uint8_t tail = this->tail.load(std::memory_order_relaxed);
+        this->tail.store((tail + 1) % SIZE, std::memory_order_release);
+    }
+
+    bool isEmpty() {
+        return tail.load(std::memory_order_relaxed) == head.load(std::memory_order_acquire);
+    }
+
+private:
+    T items[SIZE];
+    std::atomic<uint8_t> head{0};
+    std::atomic<uint8_t> tail{0};
+};
+
+#endif
@@ -0,0 +1,186 @@
+#ifndef StepScheduler_h
+#define StepScheduler_h
+
+#include <stdint.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+
+#include "MotionConfig.h"
+#include "LineInterpolator.h"
+#include "TrapezoidProfile.h"
+#include "SCurveProfile.h"
+#include "SegmentQueue.h"
+#include "Planner.h"
+#include "InputShaper.h"
+
+//How often the step timer fires, in us. Step times are quantized to this.
+#define STEP_TICK_US 100
+
+//Hardware timer used for stepping. IRremote already owns timer 1.
+#define STEP_TIMER 0
+
+//Range of the feed override, in percent of the planned speed
+#define FEED_OVERRIDE_MIN 10
+#define FEED_OVERRIDE_MAX 300
+
+//Axis that can be input shaped, X and Y. Z only lifts the pen and doesn't ring.
+#define SHAPED_AXES 2
+
+//Core the step task is pinned to. WiFi and lwIP live on core 0 so motion gets core 1.
+#define MOTION_CORE 1
+
+/*
+ * Owns step emission for every axis.
+ *
+ * On the ESP32 a hardware timer fires every STEP_TICK_US and wakes a high priority
+ * task which calls tick(). Steps are emitted from that task rather than from the ISR
+ * itself because the MCP motors need I2C, which isn't safe from interrupt context.
+ *
+ * Moves are queued as segments and stepped one after the other, so callers can
+ * stream a path without waiting on each move. The planner blends queued segments
+ * so corners don't have to come to a full stop.
+ *
+ * Everything but begin() is hardware agnostic, so a host build can drive the
+ * scheduler from virtual time with run() and check step timing without a board.
+ */
+class StepScheduler {
+public:
+    //Called once per emitted step. Returns false if the motor didn't take it, only waking
+    //coils it had released, the step is then offered again on a later tick.
+    typedef bool (*StepCallback)(uint8_t axis, bool forward);
+
+    void attach(StepCallback onStep);
+
+    //Called at the end of every tick, from the step task, so it can touch the motors too
+    typedef void (*TickCallback)(uint32_t nowUs);
+
+    void attachTick(TickCallback onTick);
+
+#ifdef ARDUINO
+    //Start the step timer and task, pinned to MOTION_CORE
+    void begin();
+#else
+    //Advance virtual time by the given us, ticking every STEP_TICK_US
+    void run(uint32_t us);
+    uint32_t now() { return virtualTime; }
+#endif
+
+    //Per axis velocity (steps/s), acceleration (steps/s^2) and jerk (steps/s^3) limits
+    void setLimits(uint8_t axis, float maxVelocity, float acceleration, float jerk = 0);
+
+    //Slack, in steps, taken up with extra steps whenever the axis reverses. They go out at the
+    //rate the path is stepping the axis, ahead of its next steps, and never show up in the
+    //axis' position.
+    void setBacklash(uint8_t axis, uint32_t steps);
+    //Which way the axis last moved when something other than the scheduler moved it
+    void setDirection(uint8_t axis, bool forward);
+
+    //Shape the axis' steps against ringing at frequency (Hz) with the given damping ratio.
+    //Only call while idle. Returns false if the axis can't be shaped or the shaper won't fit.
+    bool setShaper(uint8_t axis, ShaperType type, float frequency, float damping = 0.1f);
+
+    //How far, in steps, corners may be cut when blending segments
+    void setJunctionDeviation(float steps);
+
+    //Run everything, the line in progress included, at percent of its planned speed from the
+    //next step on. Trapezoid moves ramp to the new speed at their planned acceleration. S-curve
+    //moves are only ever slowed down, by stretching time, which can't exceed their limits either.
+    //Out of range values are clamped to FEED_OVERRIDE_MIN..FEED_OVERRIDE_MAX.
+    //Safe to call from the other core. It's the one setting that skips the motion queue, so it
+    //can act on moves already queued, and it's a single aligned word that's only ever stored
+    //whole, so the step task reads either the old value or the new one.
+    void setFeedOverride(int32_t percent);
+    int32_t getFeedOverride() { return feedOverride; }
+
+    //Profile used for lines started after this
+    void setProfileMode(ProfileMode mode) { profileMode = mode; }
+    ProfileMode getProfileMode() { return profileMode; }
+
+    //Queue a straight move of delta[] steps from the end of the last queued move,
+    //ramped so no axis exceeds its limits. feedRate caps the speed along the path,
+    //in steps/s, 0 runs as fast as the axis allow. toolOn is carried along for whatever the
+    //tool does during the move. Returns false if the queue is full.
+    bool queueLine(const int32_t delta[AXIS_COUNT], float feedRate = 0, bool toolOn = false);
+
+    //Drop the move in progress and everything queued
+    void stop();
+
+    uint8_t getQueueDepth();
+    uint8_t getQueueFree();
+
+    bool isBusy();
+    bool isBusy(uint8_t axis);
+
+    //How fast the path is stepping the axis right now, in steps/s. Follows the profile
+    //and the feed override, but not the input shaper. 0 while idle.
+    float getVelocity(uint8_t axis);
+
+    //Whether the line being stepped has the tool on, false while idle
+    bool isToolOn();
+    //Whether the line being stepped or any line queued after it has the tool on
+    bool isToolQueued();
+    //Roughly how long, in us, until the tool goes on or off, UINT32_MAX if not within horizonUs.
+    //Running out of moves turns it off. Estimated from the queued lines' speeds, ignoring their ramps.
+    uint32_t getTimeToToolChange(uint32_t horizonUs);
+
+    //Where the axis is now
+    int32_t getPosition(uint8_t axis);
+    //Where the emitted steps have put the axis, trails getPosition() on shaped axis
+    int32_t getShapedPosition(uint8_t axis);
+    //Where the axis will be once the queue is done
+    int32_t getPlannedPosition(uint8_t axis);
+    //Only call while idle, sets both positions
+    void setPosition(uint8_t axis, int32_t position);
+
+    //Emit every step that is due at nowUs
+    void tick(uint32_t nowUs);
+
+private:
+    void startSegment(const Segment &segment, float exitSpeedSqr);
+    bool isSettled(uint8_t axis);
+    uint32_t stretchInterval(uint32_t interval);
+
+    SegmentQueue queue;
+    Planner planner;
+    LineInterpolator interpolator;
+    TrapezoidProfile trapezoid;
+    SCurveProfile sCurve;
+    ProfileMode profileMode = PROFILE_TRAPEZOID;
+    ProfileMode lineMode = PROFILE_TRAPEZOID; //Mode of the line in progress
+    bool lineToolOn = false;                  //Tool state of the line in progress
+    float lineAcceleration = 0;               //Major axis acceleration of the line in progress
+    float linePathScale = 1;                  //Path steps per major axis step of the line in progress
+    volatile int32_t feedOverride = 100;      //Written from either core, see setFeedOverride()
+    float timeScale = 1;                      //Override applied to S-curves so far
+    uint32_t lastInterval = 0;                //Wait before the next step, as of the last one
+    int32_t positions[AXIS_COUNT] = {0};
+    int32_t plannedPositions[AXIS_COUNT] = {0};
+    int32_t shapedPositions[AXIS_COUNT] = {0};
+    InputShaper shapers[SHAPED_AXES];
+    float maxVelocities[AXIS_COUNT] = {0};
+    float accelerations[AXIS_COUNT] = {0};
+    float jerks[AXIS_COUNT] = {0};
+    uint32_t minIntervals[AXIS_COUNT] = {0}; //us between steps at maxVelocities
+    uint32_t backlash[AXIS_COUNT] = {0};
+    uint32_t takeUp[AXIS_COUNT] = {0};       //Backlash steps still to go after a reversal
+    uint32_t lastSteps[AXIS_COUNT] = {0};    //When the axis last stepped, path or backlash
+    uint32_t paces[AXIS_COUNT] = {0};        //us between the path's steps of the axis, as of when it last moved
+    uint8_t catchingUp = 0;                  //Axis whose path steps waited on backlash and are still behind
+    uint8_t offBeat = 0;                     //Axis whose last step was backlash or catching up
+    uint8_t directionMask = 0;               //Last direction of every axis, forward bits set
+    uint32_t nextStep = 0;
+    bool started = false; //False until tick() has timed the first step
+
+    StepCallback onStep = nullptr;
+    TickCallback onTick = nullptr;
+
+#ifndef ARDUINO
+    uint32_t virtualTime = 0;
+#endif
+};
+
+extern StepScheduler Scheduler;
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef TrapezoidProfile_h
+#define TrapezoidProfile_h
+
+#include <stdint.h>
+#include <StepperRamp.h>
+
+/*
+ * Constant acceleration (accelerate, cruise, decelerate) step timing.
+ *
+ * Intervals follow the AVR446 recurrence c[n] = c[n-1] - 2 * c[n-1] / (4n + 1),
+ * worked out by StepperRamp in integer math, so every step costs the same
+ * regardless of where we are in the ramp. The only sqrt and divides are taken
+ * once per move in begin(), and again whenever the override changes.
+ *
+ * When to decelerate isn't fixed up front. The ramp index is the number of steps
+ * it takes to stop, so each step checks whether the steps left still cover the
+ * slow down to the exit velocity. That lets the cruise speed move with the feed
+ * override mid move, the ramp gets to the new speed and still makes the exit
+ * velocity at the planned acceleration.
+ */
+class TrapezoidProfile {
+public:
+    //Plan a move of the given steps, velocities in steps/s and acceleration in steps/s^2.
+    //The entry and exit velocities have to be reachable from each other within the move.
+    //limitVelocity caps what the override may raise the cruise speed to, 0 for maxVelocity.
+    void begin(uint32_t steps, float entryVelocity, float maxVelocity, float exitVelocity, float acceleration, float limitVelocity = 0);
+
+    //Cruise at percent of maxVelocity. Cheap to call every step, it only does any work on a change.
+    void setOverride(uint16_t percent);
+
+    //Returns the us to wait before the next step
+    uint32_t next();
+
+    //Ramp lengths as planned, before any override
+    uint32_t getAccelSteps() { return accelSteps; }
+    uint32_t getDecelSteps() { return decelSteps; }
+
+    //Velocity the next step would be taken at, in steps/s
+    float getVelocity();
+
+private:
+    void plan();
+
+    StepperRamp ramp;
+    float acceleration = 0;
+    float maxVelocity = 0;
+    float limitVelocity = 0;
+    uint16_t override = 100;
+    uint32_t minInterval = 0; //Interval at cruise speed, in us
+    uint32_t cruiseN = 0;     //Ramp index at cruise speed
+    uint32_t exitN = 0;       //Ramp index to decelerate down to
+    uint32_t step = 0;        //Steps planned so far
+    uint32_t total = 0;
+    uint32_t accelSteps = 0;
+    uint32_t decelSteps = 0;
+};
+
+#endif
@@ -57,14 +57,24 @@ uint16_t Adafruit_MCP23X17::readGPIOAB() {
 
 /**************************************************************************/
 /*!
-  @brief Bulk write all pins on Port A and Port B.
+  @brief Bulk write all pins on Port A and Port B. Both go out in one write
+  when both change.
   @param value pin states to write as uint16_t.
 */
 /**************************************************************************/
 void Adafruit_MCP23X17::writeGPIOAB(uint16_t value) {
-  Adafruit_BusIO_Register GPIO(i2c_dev, spi_dev, MCP23XXX_SPIREG,
-                               getRegister(MCP23XXX_GPIO, 0), 2);
-  GPIO.write(value, 2);
+  uint8_t a = value & 0xFF;
+  uint8_t b = value >> 8;
+  if (write_through && shadow[MCP23XXX_OLAT][0] != a &&
+      shadow[MCP23XXX_OLAT][1] != b) {
+    shadow[MCP23XXX_OLAT][0] = a;
+    shadow[MCP23XXX_OLAT][1] = b;
+    writeRegister(MCP23XXX_OLAT, 0, value, 2);
+    return;
+  }
+
+  updateRegister(MCP23XXX_OLAT, 0, a);
+  updateRegister(MCP23XXX_OLAT, 1, b);
 }
 
 /**************************************************************************/
@@ -97,4 +107,5 @@ void Adafruit_MCP23X17::enableAddrPins() {
 
   GPIONoAddr.write((1 << 3), 1); // Bit3: HAEN, devices with A2 = 0
   GPIOAddr.write((1 << 3), 1);   // Devices with A2 = 1 (if any)
+  shadow[MCP23XXX_IOCON][0] = shadow[MCP23XXX_IOCON][1] = (1 << 3);
 }
\ No newline at end of file
@@ -32,7 +32,10 @@
 /**************************************************************************/
 bool Adafruit_MCP23XXX::begin_I2C(uint8_t i2c_addr, TwoWire *wire) {
   i2c_dev = new Adafruit_I2CDevice(i2c_addr, wire);
-  return i2c_dev->begin();
+  if (!i2c_dev->begin())
+    return false;
+  reloadCache();
+  return true;
 }
 
 /**************************************************************************/
@@ -49,7 +52,10 @@ bool Adafruit_MCP23XXX::begin_SPI(uint8_t cs_pin, SPIClass *theSPI,
   this->hw_addr = _hw_addr;
   spi_dev = new Adafruit_SPIDevice(cs_pin, 1000000, SPI_BITORDER_MSBFIRST,
                                    SPI_MODE0, theSPI);
-  return spi_dev->begin();
+  if (!spi_dev->begin())
+    return false;
+  reloadCache();
+  return true;
 }
 
 /**************************************************************************/
@@ -68,7 +74,10 @@ bool Adafruit_MCP23XXX::begin_SPI(int8_t cs_pin, int8_t sck_pin,
                                   uint8_t _hw_addr) {
   this->hw_addr = _hw_addr;
   spi_dev = new Adafruit_SPIDevice(cs_pin, sck_pin, miso_pin, mosi_pin);
-  return spi_dev->begin();
+  if (!spi_dev->begin())
+    return false;
+  reloadCache();
+  return true;
 }
 
 /**************************************************************************/
@@ -80,15 +89,8 @@ bool Adafruit_MCP23XXX::begin_SPI(int8_t cs_pin, int8_t sck_pin,
 */
 /**************************************************************************/
 void Adafruit_MCP23XXX::pinMode(uint8_t pin, uint8_t mode) {
-  Adafruit_BusIO_Register IODIR(i2c_dev, spi_dev, MCP23XXX_SPIREG,
-                                getRegister(MCP23XXX_IODIR, MCP_PORT(pin)));
-  Adafruit_BusIO_Register GPPU(i2c_dev, spi_dev, MCP23XXX_SPIREG,
-                               getRegister(MCP23XXX_GPPU, MCP_PORT(pin)));
-  Adafruit_BusIO_RegisterBits dir_bit(&IODIR, 1, pin % 8);
-  Adafruit_BusIO_RegisterBits pullup_bit(&GPPU, 1, pin % 8);
-
-  dir_bit.write((mode == OUTPUT) ? 0 : 1);
-  pullup_bit.write((mode == INPUT_PULLUP) ? 1 : 0);
+  updateBit(MCP23XXX_IODIR, pin, mode != OUTPUT);
+  updateBit(MCP23XXX_GPPU, pin, mode == INPUT_PULLUP);
 }
 
 /**************************************************************************/
@@ -114,11 +116,7 @@ uint8_t Adafruit_MCP23XXX::digitalRead(uint8_t pin) {
 */
 /**************************************************************************/
 void Adafruit_MCP23XXX::digitalWrite(uint8_t pin, uint8_t value) {
-  Adafruit_BusIO_Register GPIO(i2c_dev, spi_dev, MCP23XXX_SPIREG,
-                               getRegister(MCP23XXX_GPIO, MCP_PORT(pin)));
-  Adafruit_BusIO_RegisterBits pin_bit(&GPIO, 1, pin % 8);
-
-  pin_bit.write((value == LOW) ? 0 : 1);
+  updateBit(MCP23XXX_OLAT, pin, value != LOW);
 }
 
 /**************************************************************************/
@@ -142,9 +140,21 @@ uint8_t Adafruit_MCP23XXX::readGPIO(uint8_t port) {
 */
 /**************************************************************************/
 void Adafruit_MCP23XXX::writeGPIO(uint8_t value, uint8_t port) {
-  Adafruit_BusIO_Register GPIO(i2c_dev, spi_dev, MCP23XXX_SPIREG,
-                               getRegister(MCP23XXX_GPIO, port));
-  GPIO.write(value);
+  updateRegister(MCP23XXX_OLAT, port, value);
+}
+
+/**************************************************************************/
+/*!
+  @brief Write some of the pins on a port, leaving the others as they are.
+  @param mask pins to write, a bit each.
+  @param value pin states to write as a uint8_t, bits outside mask are
+  ignored.
+  @param port 0 for Port A, 1 for Port B (MCP23X17 only).
+*/
+/**************************************************************************/
+void Adafruit_MCP23XXX::updateGPIO(uint8_t mask, uint8_t value, uint8_t port) {
+  uint8_t latch = shadow[MCP23XXX_OLAT][port];
+  updateRegister(MCP23XXX_OLAT, port, (latch & ~mask) | (value & mask));
 }
 
 /**************************************************************************/
@@ -157,15 +167,11 @@ void Adafruit_MCP23XXX::writeGPIO(uint8_t value, uint8_t port) {
 /**************************************************************************/
 void Adafruit_MCP23XXX::setupInterrupts(bool mirroring, bool openDrain,
                                         uint8_t polarity) {
-  Adafruit_BusIO_Register IOCON(i2c_dev, spi_dev, MCP23XXX_SPIREG,
-                                getRegister(MCP23XXX_IOCON));
-  Adafruit_BusIO_RegisterBits mirror_bit(&IOCON, 1, 6);
-  Adafruit_BusIO_RegisterBits openDrain_bit(&IOCON, 1, 2);
-  Adafruit_BusIO_RegisterBits polarity_bit(&IOCON, 1, 1);
-
-  mirror_bit.write(mirroring ? 1 : 0);
-  openDrain_bit.write(openDrain ? 1 : 0);
-  polarity_bit.write((polarity == HIGH) ? 1 : 0);
+  updateBit(MCP23XXX_IOCON, 6, mirroring);
+  updateBit(MCP23XXX_IOCON, 2, openDrain);
+  updateBit(MCP23XXX_IOCON, 1, polarity == HIGH);
+  // both ports' addresses are the one register
+  shadow[MCP23XXX_IOCON][1] = shadow[MCP23XXX_IOCON][0];
 }
 
 /**************************************************************************/
@@ -176,19 +182,9 @@ void Adafruit_MCP23XXX::setupInterrupts(bool mirroring, bool openDrain,
 */
 /**************************************************************************/
 void Adafruit_MCP23XXX::setupInterruptPin(uint8_t pin, uint8_t mode) {
-  Adafruit_BusIO_Register GPINTEN(i2c_dev, spi_dev, MCP23XXX_SPIREG,
-                                  getRegister(MCP23XXX_GPINTEN, MCP_PORT(pin)));
-  Adafruit_BusIO_Register INTCON(i2c_dev, spi_dev, MCP23XXX_SPIREG,
-                                 getRegister(MCP23XXX_INTCON, MCP_PORT(pin)));
-  Adafruit_BusIO_Register DEFVAL(i2c_dev, spi_dev, MCP23XXX_SPIREG,
-                                 getRegister(MCP23XXX_DEFVAL, MCP_PORT(pin)));
-  Adafruit_BusIO_RegisterBits enable_bit(&GPINTEN, 1, pin % 8);
-  Adafruit_BusIO_RegisterBits config_bit(&INTCON, 1, pin % 8);
-  Adafruit_BusIO_RegisterBits defval_bit(&DEFVAL, 1, pin % 8);
-
-  enable_bit.write(1);                        // enable it
-  config_bit.write((mode == CHANGE) ? 0 : 1); // set mode
-  defval_bit.write((mode == LOW) ? 1 : 0);    // set defval
+  updateBit(MCP23XXX_GPINTEN, pin, true);          // enable it
+  updateBit(MCP23XXX_INTCON, pin, mode != CHANGE); // set mode
+  updateBit(MCP23XXX_DEFVAL, pin, mode == LOW);    // set defval
 }
 
 /**************************************************************************/
@@ -198,11 +194,7 @@ void Adafruit_MCP23XXX::setupInterruptPin(uint8_t pin, uint8_t mode) {
 */
 /**************************************************************************/
 void Adafruit_MCP23XXX::disableInterruptPin(uint8_t pin) {
-  Adafruit_BusIO_Register GPINTEN(i2c_dev, spi_dev, MCP23XXX_SPIREG,
-                                  getRegister(MCP23XXX_GPINTEN, MCP_PORT(pin)));
-  Adafruit_BusIO_RegisterBits enable_bit(&GPINTEN, 1, pin % 8);
-
-  enable_bit.write(0);
+  updateBit(MCP23XXX_GPINTEN, pin, false);
 }
 
 /**************************************************************************/
@@ -250,6 +242,127 @@ uint8_t Adafruit_MCP23XXX::getLastInterruptPin() {
   return intpin;
 }
 
+/**************************************************************************/
+/*!
+  @brief Gets the pin states captured when the last interrupt fired, and
+         clears it. Pins that keep the interrupt condition will fire again.
+  @returns Captured pin states, Port A in the low byte and Port B in the
+           high byte (MCP23X17 only).
+*/
+/**************************************************************************/
+uint16_t Adafruit_MCP23XXX::getCapturedInterrupt() {
+  Adafruit_BusIO_Register INTCAP(i2c_dev, spi_dev, MCP23XXX_SPIREG,
+                                 getRegister(MCP23XXX_INTCAP),
+                                 (pinCount > 8) ? 2 : 1);
+  return INTCAP.read();
+}
+
+/**************************************************************************/
+/*!
+  @brief Choose whether register changes are written right away, the
+  default, or held until flush(). Holding them lets several changes go out
+  together, both ports of a register in one write on the MCP23X17.
+  Turning write-through back on flushes anything held.
+  @param enabled true to write changes right away.
+*/
+/**************************************************************************/
+void Adafruit_MCP23XXX::setWriteThrough(bool enabled) {
+  write_through = enabled;
+  if (enabled)
+    flush();
+}
+
+/**************************************************************************/
+/*!
+  @brief Write every register change held since the last flush.
+*/
+/**************************************************************************/
+void Adafruit_MCP23XXX::flush() {
+  for (uint8_t reg = 0; reg <= MCP23XXX_OLAT && dirty; reg++) {
+    uint8_t ports = (dirty >> (reg * 2)) & 0b11;
+    if (ports == 0b11)
+      writeRegister(reg, 0, shadow[reg][1] << 8 | shadow[reg][0], 2);
+    else if (ports)
+      writeRegister(reg, ports >> 1, shadow[reg][ports >> 1]);
+    dirty &= ~(0b11UL << (reg * 2));
+  }
+}
+
+/**************************************************************************/
+/*!
+  @brief Read the writable registers back into the cache, dropping any
+  changes not flushed yet. begin_I2C() and begin_SPI() do this, call it
+  again if something else writes the chip.
+*/
+/**************************************************************************/
+void Adafruit_MCP23XXX::reloadCache() {
+  uint8_t ports = (pinCount > 8) ? 2 : 1;
+  for (uint8_t reg = 0; reg <= MCP23XXX_OLAT; reg++) {
+    // flags, captures and pin states aren't written, so aren't cached
+    if (reg == MCP23XXX_INTF || reg == MCP23XXX_INTCAP || reg == MCP23XXX_GPIO)
+      continue;
+
+    Adafruit_BusIO_Register REG(i2c_dev, spi_dev, MCP23XXX_SPIREG,
+                                getRegister(reg, 0), ports);
+    uint16_t value = REG.read();
+    shadow[reg][0] = value & 0xFF;
+    shadow[reg][1] = value >> 8;
+  }
+  dirty = 0;
+}
+
+/**************************************************************************/
+/*!
+  @brief Change a cached register, writing it unless the value is the same
+  or writes are being held for flush().
+  @param baseAddress base register address
+  @param port 0 for A, 1 for B (MCP23X17 only)
+  @param value new register value
+*/
+/**************************************************************************/
+void Adafruit_MCP23XXX::updateRegister(uint8_t baseAddress, uint8_t port,
+                                       uint8_t value) {
+  if (shadow[baseAddress][port] == value)
+    return;
+
+  shadow[baseAddress][port] = value;
+  if (write_through)
+    writeRegister(baseAddress, port, value);
+  else
+    dirty |= 1UL << (baseAddress * 2 + port);
+}
+
+/**************************************************************************/
+/*!
+  @brief Change one bit of a cached register.
+  @param baseAddress base register address
+  @param pin the pin the bit is for, which also picks the port
+  @param set true to set the bit, false to clear it
+*/
+/**************************************************************************/
+void Adafruit_MCP23XXX::updateBit(uint8_t baseAddress, uint8_t pin, bool set) {
+  uint8_t port = MCP_PORT(pin);
+  uint8_t value = shadow[baseAddress][port];
+  uint8_t bit = 1 << (pin % 8);
+  updateRegister(baseAddress, port, set ? (value | bit) : (value & ~bit));
+}
+
+/**************************************************************************/
+/*!
+  @brief Write a register, or both ports of one when width is 2.
+  @param baseAddress base register address
+  @param port 0 for A, 1 for B (MCP23X17 only)
+  @param value register value, Port A in the low byte for width 2
+  @param width bytes to write
+*/
+/**************************************************************************/
+void Adafruit_MCP23XXX::writeRegister(uint8_t baseAddress, uint8_t port,
+                                      uint16_t value, uint8_t width) {
+  Adafruit_BusIO_Register REG(i2c_dev, spi_dev, MCP23XXX_SPIREG,
+                              getRegister(baseAddress, port), width);
+  REG.write(value, width);
+}
+
 /**************************************************************************/
 /*!
   @brief helper to get register address
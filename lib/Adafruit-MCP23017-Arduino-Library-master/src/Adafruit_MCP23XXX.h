@@ -52,12 +52,19 @@ public:
   // bulk access
   uint8_t readGPIO(uint8_t port = 0);
   void writeGPIO(uint8_t value, uint8_t port = 0);
+  void updateGPIO(uint8_t mask, uint8_t value, uint8_t port = 0);
+
+  // register cache
+  void setWriteThrough(bool enabled);
+  void flush();
+  void reloadCache();
 
   // interrupts
   void setupInterrupts(bool mirroring, bool openDrain, uint8_t polarity);
   void setupInterruptPin(uint8_t pin, uint8_t mode = CHANGE);
   void disableInterruptPin(uint8_t pin);
   uint8_t getLastInterruptPin();
+  uint16_t getCapturedInterrupt();
 
 protected:
   Adafruit_I2CDevice *i2c_dev = NULL; ///< Pointer to I2C bus interface
@@ -66,6 +73,14 @@ protected:
   uint8_t hw_addr;                    ///< HW address matching A2/A1/A0 pins
   uint16_t getRegister(uint8_t baseAddress, uint8_t port = 0);
 
+  uint8_t shadow[MCP23XXX_OLAT + 1][2] = {{0}}; ///< Writable registers, by port
+  uint32_t dirty = 0; ///< Shadowed registers not written yet, a bit per port
+  bool write_through = true; ///< Write changes right away, not on flush()
+  void updateRegister(uint8_t baseAddress, uint8_t port, uint8_t value);
+  void updateBit(uint8_t baseAddress, uint8_t pin, bool set);
+  void writeRegister(uint8_t baseAddress, uint8_t port, uint16_t value,
+                     uint8_t width = 1);
+
 private:
   uint8_t buffer[4];
 };
@@ -61,6 +61,19 @@
  *    3  0  1  0  1
  *    4  1  0  0  1
  *
+ * Half stepping a 4 wire motor puts a single coil phase between each of those,
+ * and wave drive only uses the single coil phases:
+ *
+ * Step C0 C1 C2 C3
+ *    1  1  0  1  0
+ *    2  0  0  1  0
+ *    3  0  1  1  0
+ *    4  0  1  0  0
+ *    5  0  1  0  1
+ *    6  0  0  0  1
+ *    7  1  0  0  1
+ *    8  1  0  0  0
+ *
  * The sequence of control signals for 2 control wires is as follows
  * (columns C1 and C2 from above):
  *
@@ -83,11 +96,21 @@
  *   constructor for four-pin version
  *   Sets which wires should control the motor.
  */
-Stepper::Stepper(int number_of_steps, int motor_pin_1, int motor_pin_2, int motor_pin_3, int motor_pin_4, bool useMCP, Adafruit_MCP23X17 smcp) {
-    this->mcp = smcp;
+Stepper::Stepper(int number_of_steps, int motor_pin_1, int motor_pin_2, int motor_pin_3, int motor_pin_4, bool useMCP, Adafruit_MCP23X17 &mcp) {
+    this->mcp = &mcp;
 
     this->step_number = 0;    // which step the motor is on
     this->direction = 0;      // motor direction
+    this->acceleration = 0;   // no ramp until setAcceleration() is called
+    this->drive_mode = STEPPER_FULL_STEP;
+    this->phase = 0;          // which entry of the phase table is energised
+    this->position = 0;       // steps from where we started
+    this->target_position = 0;
+    this->tick_delay = 0;
+    this->moving = false;
+    this->hold_time = 0;      // coils stay on until setHoldTime() says otherwise
+    this->energised_time = 0;
+    this->released = false;
     this->last_step_time = 0; // timestamp in us of the last step taken
     this->number_of_steps = number_of_steps; // total number of steps for this motor
 
@@ -100,10 +123,10 @@ Stepper::Stepper(int number_of_steps, int motor_pin_1, int motor_pin_2, int moto
     // setup the pins on the microcontroller:
     if (useMCP) {
         this->useMCP = true;
-        this->mcp.pinMode(this->motor_pin_1, OUTPUT);
-        this->mcp.pinMode(this->motor_pin_2, OUTPUT);
-        this->mcp.pinMode(this->motor_pin_3, OUTPUT);
-        this->mcp.pinMode(this->motor_pin_4, OUTPUT);
+        this->mcp->pinMode(this->motor_pin_1, OUTPUT);
+        this->mcp->pinMode(this->motor_pin_2, OUTPUT);
+        this->mcp->pinMode(this->motor_pin_3, OUTPUT);
+        this->mcp->pinMode(this->motor_pin_4, OUTPUT);
     } else {
         pinMode(this->motor_pin_1, OUTPUT);
         pinMode(this->motor_pin_2, OUTPUT);
@@ -125,302 +148,291 @@ void Stepper::setSpeed(long whatSpeed) {
     this->step_delay = 60L * 1000L * 1000L / this->number_of_steps / whatSpeed;
 }
 
+/*
+ * Picks how 4 wire motors are driven. Half stepping doubles the steps per
+ * revolution, so number_of_steps should count half steps when using it.
+ * Has no effect on 2 wire and 5 phase motors.
+ */
+void Stepper::setDriveMode(StepperDriveMode mode) {
+    this->drive_mode = mode;
+
+    // line up with the phases the new mode uses, the next step moves from there:
+    if (mode == STEPPER_FULL_STEP)
+        this->phase &= ~1;
+    else if (mode == STEPPER_WAVE)
+        this->phase |= 1;
+}
+
+/*
+ * Sets the acceleration step() ramps with, in steps per second per second.
+ * 0 turns the ramp off and steps at the setSpeed() rate throughout.
+ */
+void Stepper::setAcceleration(long whatAcceleration) {
+    this->acceleration = whatAcceleration > 0 ? whatAcceleration : 0;
+}
+
 /*
  * Moves the motor steps_to_move steps.  If the number is negative,
- * the motor moves in the reverse direction.
+ * the motor moves in the reverse direction. Blocks until the move is done,
+ * use move() and tick() to keep running other code in the meantime.
  */
 void Stepper::step(int steps_to_move) {
-    int steps_left = abs(steps_to_move);  // how many steps to take
-
-    // determine direction based on whether steps_to_mode is + or -:
-    if (steps_to_move > 0) { this->direction = 1; }
-    if (steps_to_move < 0) { this->direction = 0; }
-
-
-    // decrement the number of steps, moving one step each time:
-    while (steps_left > 0) {
-        unsigned long now = micros();
-        // move only if the appropriate delay has passed:
-        if (now - this->last_step_time >= this->step_delay) {
-            // get the timeStamp of when you stepped:
-            this->last_step_time = now;
-            // increment or decrement the step number,
-            // depending on direction:
-            if (this->direction == 1) {
-                this->step_number++;
-                if (this->step_number == this->number_of_steps) {
-                    this->step_number = 0;
-                }
-            } else {
-                if (this->step_number == 0) {
-                    this->step_number = this->number_of_steps;
-                }
-                this->step_number--;
-            }
-            // decrement the steps left:
-            steps_left--;
-            // step the motor to step number 0, 1, ..., {3 or 10}
-            if (this->pin_count == 5)
-                stepMotor(this->step_number % 10);
-            else
-                stepMotor(this->step_number % 4);
+    move(steps_to_move);
+
+    // tick until we get there, moving one step each time:
+    while (isBusy())
+        tick(micros());
+}
+
+/*
+ * Sets an absolute target position in steps for tick() to run to.
+ */
+void Stepper::moveTo(long target) {
+    this->target_position = target;
+}
+
+/*
+ * Sets a target relative to where the motor is now.
+ */
+void Stepper::move(long steps_to_move) {
+    moveTo(this->position + steps_to_move);
+}
+
+/*
+ * Steps left to the target, negative when it's behind us.
+ */
+long Stepper::remaining() {
+    return this->target_position - this->position;
+}
+
+/*
+ * True until the target is reached and the motor has slowed to a stop.
+ */
+bool Stepper::isBusy() {
+    bool slowing = this->moving && this->acceleration > 0 && this->tick_ramp.index() > 0;
+    return this->target_position != this->position || slowing;
+}
+
+/*
+ * Takes at most one step towards the target if it's due at now (in us),
+ * and returns whether it did. Never waits, so it can be polled from a
+ * scheduler alongside other motors. Returns false once the target is reached.
+ */
+bool Stepper::tick(unsigned long now) {
+    long to_go = this->target_position - this->position;
+    if (!isBusy()) {
+        this->moving = false;
+        releaseIfIdle(now);
+        return false;
+    }
+
+    if (!this->moving) {
+        // starting from standstill, with an acceleration set start slow and ramp up to step_delay:
+        this->moving = true;
+        this->direction = to_go > 0 ? 1 : 0;
+        this->tick_delay = this->step_delay;
+        if (this->acceleration > 0) {
+            this->tick_ramp.begin(this->acceleration);
+            if (this->tick_ramp.interval() > this->tick_delay)
+                this->tick_delay = this->tick_ramp.interval();
         }
+
+        // after a long wait step right away rather than catching up
+        if (now - this->last_step_time >= this->tick_delay)
+            this->last_step_time = now - this->tick_delay;
+    }
+
+    // move only if the appropriate delay has passed:
+    if (now - this->last_step_time < this->tick_delay)
+        return false;
+
+    // schedule from when the step was due so polling jitter doesn't build up:
+    this->last_step_time += this->tick_delay;
+
+    // a reversed target has to wait for us to slow down going the other way first:
+    bool forward = to_go > 0;
+    bool slowing = this->acceleration > 0 && this->tick_ramp.index() > 0;
+    if (slowing && (to_go == 0 || forward != (this->direction == 1)))
+        forward = this->direction == 1;
+
+    // released coils only wake up this time, the step follows a delay later:
+    if (!stepNow(forward))
+        return false;
+
+    if (this->acceleration > 0) {
+        long left = this->target_position - this->position;
+        bool reversing = left != 0 && (left > 0) != forward;
+
+        // the ramp index is how many steps it takes to stop from here
+        if (reversing || this->tick_ramp.index() >= (unsigned long)labs(left))
+            this->tick_ramp.decelerate();
+        else if (this->tick_ramp.interval() > this->step_delay)
+            this->tick_ramp.accelerate();
+
+        this->tick_delay = this->step_delay;
+        if (this->tick_ramp.interval() > this->tick_delay)
+            this->tick_delay = this->tick_ramp.interval();
     }
+
+    return true;
 }
 
 /*
- * Moves the motor forward or backwards.
+ * Takes a single step in the given direction immediately. Timing is left
+ * to the caller, which lets a scheduler drive several motors at once.
+ *
+ * If the coils were released it doesn't step. The rotor is still sitting
+ * on the phase it was released at, so that phase is driven again instead
+ * and false returned. The caller should offer the step again no sooner
+ * than its next tick, once the rotor is held there, so no steps are lost.
  */
-void Stepper::stepMotor(int thisStep) {
-    if (this->pin_count == 2) {
-        if (this->useMCP) {
-            switch (thisStep) {
-                case 0:  // 01
-                    this->mcp.digitalWrite(motor_pin_1, LOW);
-                    this->mcp.digitalWrite(motor_pin_2, HIGH);
-                    break;
-                case 1:  // 11
-                    this->mcp.digitalWrite(motor_pin_1, HIGH);
-                    this->mcp.digitalWrite(motor_pin_2, HIGH);
-                    break;
-                case 2:  // 10
-                    this->mcp.digitalWrite(motor_pin_1, HIGH);
-                    this->mcp.digitalWrite(motor_pin_2, LOW);
-                    break;
-                case 3:  // 00
-                    this->mcp.digitalWrite(motor_pin_1, LOW);
-                    this->mcp.digitalWrite(motor_pin_2, LOW);
-                    break;
-            }
-        } else {
-            switch (thisStep) {
-                case 0:  // 01
-                    digitalWrite(motor_pin_1, LOW);
-                    digitalWrite(motor_pin_2, HIGH);
-                    break;
-                case 1:  // 11
-                    digitalWrite(motor_pin_1, HIGH);
-                    digitalWrite(motor_pin_2, HIGH);
-                    break;
-                case 2:  // 10
-                    digitalWrite(motor_pin_1, HIGH);
-                    digitalWrite(motor_pin_2, LOW);
-                    break;
-                case 3:  // 00
-                    digitalWrite(motor_pin_1, LOW);
-                    digitalWrite(motor_pin_2, LOW);
-                    break;
-            }
-        }
+bool Stepper::stepNow(bool forward) {
+    if (this->released) {
+        stepMotor(this->phase);
+        return false;
+    }
 
+    this->direction = forward ? 1 : 0;
+    this->position += forward ? 1 : -1;
+
+    // increment or decrement the step number,
+    // depending on direction:
+    if (this->direction == 1) {
+        this->step_number++;
+        if (this->step_number == this->number_of_steps) {
+            this->step_number = 0;
+        }
+    } else {
+        if (this->step_number == 0) {
+            this->step_number = this->number_of_steps;
+        }
+        this->step_number--;
     }
+    // move on to the next phase, full and wave drive skip every other one:
+    int phase_count = 4;
+    int stride = 1;
     if (this->pin_count == 4) {
-        if (this->useMCP) {
-            switch (thisStep) {
-                case 0:  // 1010
-                    this->mcp.digitalWrite(motor_pin_1, HIGH);
-                    this->mcp.digitalWrite(motor_pin_2, LOW);
-                    this->mcp.digitalWrite(motor_pin_3, HIGH);
-                    this->mcp.digitalWrite(motor_pin_4, LOW);
-                    break;
-                case 1:  // 0110
-                    this->mcp.digitalWrite(motor_pin_1, LOW);
-                    this->mcp.digitalWrite(motor_pin_2, HIGH);
-                    this->mcp.digitalWrite(motor_pin_3, HIGH);
-                    this->mcp.digitalWrite(motor_pin_4, LOW);
-                    break;
-                case 2:  //0101
-                    this->mcp.digitalWrite(motor_pin_1, LOW);
-                    this->mcp.digitalWrite(motor_pin_2, HIGH);
-                    this->mcp.digitalWrite(motor_pin_3, LOW);
-                    this->mcp.digitalWrite(motor_pin_4, HIGH);
-                    break;
-                case 3:  //1001
-                    this->mcp.digitalWrite(motor_pin_1, HIGH);
-                    this->mcp.digitalWrite(motor_pin_2, LOW);
-                    this->mcp.digitalWrite(motor_pin_3, LOW);
-                    this->mcp.digitalWrite(motor_pin_4, HIGH);
-                    break;
-            }
-        } else {
-            switch (thisStep) {
-                case 0:  // 1010
-                    digitalWrite(motor_pin_1, HIGH);
-                    digitalWrite(motor_pin_2, LOW);
-                    digitalWrite(motor_pin_3, HIGH);
-                    digitalWrite(motor_pin_4, LOW);
-                    break;
-                case 1:  // 0110
-                    digitalWrite(motor_pin_1, LOW);
-                    digitalWrite(motor_pin_2, HIGH);
-                    digitalWrite(motor_pin_3, HIGH);
-                    digitalWrite(motor_pin_4, LOW);
-                    break;
-                case 2:  //0101
-                    digitalWrite(motor_pin_1, LOW);
-                    digitalWrite(motor_pin_2, HIGH);
-                    digitalWrite(motor_pin_3, LOW);
-                    digitalWrite(motor_pin_4, HIGH);
-                    break;
-                case 3:  //1001
-                    digitalWrite(motor_pin_1, HIGH);
-                    digitalWrite(motor_pin_2, LOW);
-                    digitalWrite(motor_pin_3, LOW);
-                    digitalWrite(motor_pin_4, HIGH);
-                    break;
-            }
-        }
+        phase_count = 8;
+        if (this->drive_mode != STEPPER_HALF_STEP)
+            stride = 2;
+    } else if (this->pin_count == 5) {
+        phase_count = 10;
     }
 
-    if (this->pin_count == 5) {
-        if (this->useMCP) {
-            switch (thisStep) {
-                case 0:  // 01101
-                    this->mcp.digitalWrite(motor_pin_1, LOW);
-                    this->mcp.digitalWrite(motor_pin_2, HIGH);
-                    this->mcp.digitalWrite(motor_pin_3, HIGH);
-                    this->mcp.digitalWrite(motor_pin_4, LOW);
-                    this->mcp.digitalWrite(motor_pin_5, HIGH);
-                    break;
-                case 1:  // 01001
-                    this->mcp.digitalWrite(motor_pin_1, LOW);
-                    this->mcp.digitalWrite(motor_pin_2, HIGH);
-                    this->mcp.digitalWrite(motor_pin_3, LOW);
-                    this->mcp.digitalWrite(motor_pin_4, LOW);
-                    this->mcp.digitalWrite(motor_pin_5, HIGH);
-                    break;
-                case 2:  // 01011
-                    this->mcp.digitalWrite(motor_pin_1, LOW);
-                    this->mcp.digitalWrite(motor_pin_2, HIGH);
-                    this->mcp.digitalWrite(motor_pin_3, LOW);
-                    this->mcp.digitalWrite(motor_pin_4, HIGH);
-                    this->mcp.digitalWrite(motor_pin_5, HIGH);
-                    break;
-                case 3:  // 01010
-                    this->mcp.digitalWrite(motor_pin_1, LOW);
-                    this->mcp.digitalWrite(motor_pin_2, HIGH);
-                    this->mcp.digitalWrite(motor_pin_3, LOW);
-                    this->mcp.digitalWrite(motor_pin_4, HIGH);
-                    this->mcp.digitalWrite(motor_pin_5, LOW);
-                    break;
-                case 4:  // 11010
-                    this->mcp.digitalWrite(motor_pin_1, HIGH);
-                    this->mcp.digitalWrite(motor_pin_2, HIGH);
-                    this->mcp.digitalWrite(motor_pin_3, LOW);
-                    this->mcp.digitalWrite(motor_pin_4, HIGH);
-                    this->mcp.digitalWrite(motor_pin_5, LOW);
-                    break;
-                case 5:  // 10010
-                    this->mcp.digitalWrite(motor_pin_1, HIGH);
-                    this->mcp.digitalWrite(motor_pin_2, LOW);
-                    this->mcp.digitalWrite(motor_pin_3, LOW);
-                    this->mcp.digitalWrite(motor_pin_4, HIGH);
-                    this->mcp.digitalWrite(motor_pin_5, LOW);
-                    break;
-                case 6:  // 10110
-                    this->mcp.digitalWrite(motor_pin_1, HIGH);
-                    this->mcp.digitalWrite(motor_pin_2, LOW);
-                    this->mcp.digitalWrite(motor_pin_3, HIGH);
-                    this->mcp.digitalWrite(motor_pin_4, HIGH);
-                    this->mcp.digitalWrite(motor_pin_5, LOW);
-                    break;
-                case 7:  // 10100
-                    this->mcp.digitalWrite(motor_pin_1, HIGH);
-                    this->mcp.digitalWrite(motor_pin_2, LOW);
-                    this->mcp.digitalWrite(motor_pin_3, HIGH);
-                    this->mcp.digitalWrite(motor_pin_4, LOW);
-                    this->mcp.digitalWrite(motor_pin_5, LOW);
-                    break;
-                case 8:  // 10101
-                    this->mcp.digitalWrite(motor_pin_1, HIGH);
-                    this->mcp.digitalWrite(motor_pin_2, LOW);
-                    this->mcp.digitalWrite(motor_pin_3, HIGH);
-                    this->mcp.digitalWrite(motor_pin_4, LOW);
-                    this->mcp.digitalWrite(motor_pin_5, HIGH);
-                    break;
-                case 9:  // 00101
-                    this->mcp.digitalWrite(motor_pin_1, LOW);
-                    this->mcp.digitalWrite(motor_pin_2, LOW);
-                    this->mcp.digitalWrite(motor_pin_3, HIGH);
-                    this->mcp.digitalWrite(motor_pin_4, LOW);
-                    this->mcp.digitalWrite(motor_pin_5, HIGH);
-                    break;
-            }
-        } else {
-            switch (thisStep) {
-                case 0:  // 01101
-                    digitalWrite(motor_pin_1, LOW);
-                    digitalWrite(motor_pin_2, HIGH);
-                    digitalWrite(motor_pin_3, HIGH);
-                    digitalWrite(motor_pin_4, LOW);
-                    digitalWrite(motor_pin_5, HIGH);
-                    break;
-                case 1:  // 01001
-                    digitalWrite(motor_pin_1, LOW);
-                    digitalWrite(motor_pin_2, HIGH);
-                    digitalWrite(motor_pin_3, LOW);
-                    digitalWrite(motor_pin_4, LOW);
-                    digitalWrite(motor_pin_5, HIGH);
-                    break;
-                case 2:  // 01011
-                    digitalWrite(motor_pin_1, LOW);
-                    digitalWrite(motor_pin_2, HIGH);
-                    digitalWrite(motor_pin_3, LOW);
-                    digitalWrite(motor_pin_4, HIGH);
-                    digitalWrite(motor_pin_5, HIGH);
-                    break;
-                case 3:  // 01010
-                    digitalWrite(motor_pin_1, LOW);
-                    digitalWrite(motor_pin_2, HIGH);
-                    digitalWrite(motor_pin_3, LOW);
-                    digitalWrite(motor_pin_4, HIGH);
-                    digitalWrite(motor_pin_5, LOW);
-                    break;
-                case 4:  // 11010
-                    digitalWrite(motor_pin_1, HIGH);
-                    digitalWrite(motor_pin_2, HIGH);
-                    digitalWrite(motor_pin_3, LOW);
-                    digitalWrite(motor_pin_4, HIGH);
-                    digitalWrite(motor_pin_5, LOW);
-                    break;
-                case 5:  // 10010
-                    digitalWrite(motor_pin_1, HIGH);
-                    digitalWrite(motor_pin_2, LOW);
-                    digitalWrite(motor_pin_3, LOW);
-                    digitalWrite(motor_pin_4, HIGH);
-                    digitalWrite(motor_pin_5, LOW);
-                    break;
-                case 6:  // 10110
-                    digitalWrite(motor_pin_1, HIGH);
-                    digitalWrite(motor_pin_2, LOW);
-                    digitalWrite(motor_pin_3, HIGH);
-                    digitalWrite(motor_pin_4, HIGH);
-                    digitalWrite(motor_pin_5, LOW);
-                    break;
-                case 7:  // 10100
-                    digitalWrite(motor_pin_1, HIGH);
-                    digitalWrite(motor_pin_2, LOW);
-                    digitalWrite(motor_pin_3, HIGH);
-                    digitalWrite(motor_pin_4, LOW);
-                    digitalWrite(motor_pin_5, LOW);
-                    break;
-                case 8:  // 10101
-                    digitalWrite(motor_pin_1, HIGH);
-                    digitalWrite(motor_pin_2, LOW);
-                    digitalWrite(motor_pin_3, HIGH);
-                    digitalWrite(motor_pin_4, LOW);
-                    digitalWrite(motor_pin_5, HIGH);
-                    break;
-                case 9:  // 00101
-                    digitalWrite(motor_pin_1, LOW);
-                    digitalWrite(motor_pin_2, LOW);
-                    digitalWrite(motor_pin_3, HIGH);
-                    digitalWrite(motor_pin_4, LOW);
-                    digitalWrite(motor_pin_5, HIGH);
-                    break;
-            }
+    if (this->direction == 1)
+        this->phase = (this->phase + stride) % phase_count;
+    else
+        this->phase = (this->phase + phase_count - stride) % phase_count;
+
+    stepMotor(this->phase);
+    return true;
+}
+
+/*
+ * Sets how long the coils stay energised after the last step, in us.
+ * Holding keeps the motor stiff but the coils draw full current and heat
+ * up while doing nothing, releasing lets it idle cold. 0 never releases.
+ */
+void Stepper::setHoldTime(unsigned long hold_us) {
+    this->hold_time = hold_us;
+}
+
+/*
+ * Turns every coil off. The phase is remembered, the next stepNow() drives
+ * it again rather than stepping. 2 wire motors can't be released, every
+ * one of their patterns energises a coil.
+ */
+void Stepper::release() {
+    if (this->released || this->pin_count == 2)
+        return;
+
+    writeCoils(0);
+    this->released = true;
+}
+
+/*
+ * Releases the coils if they've been on for the hold time without a step,
+ * and returns whether it did. Cheap enough to poll alongside tick().
+ */
+bool Stepper::releaseIfIdle(unsigned long now) {
+    if (this->hold_time == 0 || this->released)
+        return false;
+    // a step taken after now was read shouldn't look like a long idle:
+    long idle = (long)(now - this->energised_time);
+    if (idle < (long)this->hold_time)
+        return false;
+
+    release();
+    return this->released;
+}
+
+/*
+ * Coil patterns for each phase, the first motor pin is the most significant bit.
+ *
+ * The 4 wire table is the 8 phase half step sequence. Full stepping walks its
+ * even phases (two coils on) and wave drive its odd phases (one coil on), so
+ * switching mode never needs more than a half step to line up.
+ */
+static const uint8_t twoWirePhases[4] = {
+    0b01, 0b11, 0b10, 0b00
+};
+static const uint8_t fourWirePhases[8] = {
+    0b1010, 0b0010, 0b0110, 0b0100, 0b0101, 0b0001, 0b1001, 0b1000
+};
+static const uint8_t fivePhasePhases[10] = {
+    0b01101, 0b01001, 0b01011, 0b01010, 0b11010,
+    0b10010, 0b10110, 0b10100, 0b10101, 0b00101
+};
+
+/*
+ * Energises the coils for the given phase.
+ */
+void Stepper::stepMotor(int thisStep) {
+    uint8_t pattern;
+    if (this->pin_count == 2)
+        pattern = twoWirePhases[thisStep];
+    else if (this->pin_count == 4)
+        pattern = fourWirePhases[thisStep];
+    else
+        pattern = fivePhasePhases[thisStep];
+
+    writeCoils(pattern);
+    this->energised_time = micros();
+    this->released = false;
+}
+
+/*
+ * Drives every motor pin from a phase pattern, first pin in the most
+ * significant bit. An MCP motor updates each port its pins are on in one
+ * go. The driver knows what the other pins on the port are set to, so a
+ * step is a single write for a motor on one port, and none if nothing
+ * changed. While the driver holds writes for flush(), motors stepping
+ * together share the write.
+ */
+void Stepper::writeCoils(uint8_t pattern) {
+    const int pins[5] = {motor_pin_1, motor_pin_2, motor_pin_3, motor_pin_4, motor_pin_5};
+
+    if (this->useMCP) {
+        uint8_t masks[2] = {0, 0};
+        uint8_t levels[2] = {0, 0};
+        for (int i = 0; i < this->pin_count; i++) {
+            uint8_t port = MCP_PORT(pins[i]);
+            uint8_t bit = 1 << (pins[i] % 8);
+            masks[port] |= bit;
+            if ((pattern >> (this->pin_count - 1 - i)) & 1)
+                levels[port] |= bit;
         }
 
+        for (uint8_t port = 0; port < 2; port++) {
+            if (masks[port] != 0)
+                this->mcp->updateGPIO(masks[port], levels[port], port);
+        }
+        return;
+    }
+
+    for (int i = 0; i < this->pin_count; i++) {
+        uint8_t level = (pattern >> (this->pin_count - 1 - i)) & 1 ? HIGH : LOW;
+        digitalWrite(pins[i], level);
     }
 }
 
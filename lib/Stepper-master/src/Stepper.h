@@ -61,6 +61,19 @@
  *    3  0  1  0  1
  *    4  1  0  0  1
  *
+ * Half stepping a 4 wire motor puts a single coil phase between each of those,
+ * and wave drive only uses the single coil phases:
+ *
+ * Step C0 C1 C2 C3
+ *    1  1  0  1  0
+ *    2  0  0  1  0
+ *    3  0  1  1  0
+ *    4  0  1  0  0
+ *    5  0  1  0  1
+ *    6  0  0  0  1
+ *    7  1  0  0  1
+ *    8  1  0  0  0
+ *
  * The sequence of control signals for 2 control wires is as follows
  * (columns C1 and C2 from above):
  *
@@ -76,11 +89,19 @@
  */
 
 #include <Adafruit_MCP23X17.h>
+#include "StepperRamp.h"
 
 // ensure this library description is only included once
 #ifndef Stepper_h
 #define Stepper_h
 
+// how a 4 wire motor's coils are driven:
+enum StepperDriveMode {
+  STEPPER_FULL_STEP, // two coils on at a time, full torque
+  STEPPER_WAVE,      // one coil on at a time, less torque and current
+  STEPPER_HALF_STEP  // alternates one and two coils, twice the resolution
+};
+
 // library interface description
 class Stepper {
   public:
@@ -89,7 +110,7 @@ class Stepper {
     Stepper(int number_of_steps, int motor_pin_1, int motor_pin_2,
                                  int motor_pin_3, int motor_pin_4);
     Stepper(int number_of_steps, int motor_pin_1, int motor_pin_2,
-            int motor_pin_3, int motor_pin_4, bool useMCP, Adafruit_MCP23X17 mcp);
+            int motor_pin_3, int motor_pin_4, bool useMCP, Adafruit_MCP23X17 &mcp);
     Stepper(int number_of_steps, int motor_pin_1, int motor_pin_2,
                                  int motor_pin_3, int motor_pin_4,
                                  int motor_pin_5);
@@ -97,23 +118,52 @@ class Stepper {
     // speed setter method:
     void setSpeed(long whatSpeed);
 
-    // mover method:
+    // selects wave, full step or half step drive for 4 wire motors:
+    void setDriveMode(StepperDriveMode mode);
+
+    // ramps step() up to speed and back down, in steps/s^2, 0 to step at a constant speed:
+    void setAcceleration(long whatAcceleration);
+
+    // mover method, blocks until the steps are done:
     void step(int number_of_steps);
 
+    // non-blocking movers, set a target then call tick() until it's reached:
+    void moveTo(long target);
+    void move(long steps_to_move);
+    bool tick(unsigned long now);
+    long remaining();
+    bool isBusy();
+    long currentPosition() { return this->position; }
+
+    // takes a single step right away without waiting on step_delay, false if it
+    // only re-energised released coils and the step has to be offered again later:
+    bool stepNow(bool forward);
+
+    // turns the coils off after hold_us without a step, 0 keeps them on:
+    void setHoldTime(unsigned long hold_us);
+    void release();
+    bool releaseIfIdle(unsigned long now);
+    bool isReleased() { return this->released; }
+
     int version(void);
 
     bool useMCP = false;
 
-    Adafruit_MCP23X17 mcp;
+    // shared with every other motor and user of the expander, so they all see one set of registers:
+    Adafruit_MCP23X17 *mcp = nullptr;
 
   private:
     void stepMotor(int this_step);
+    void writeCoils(uint8_t pattern);
 
     int direction;            // Direction of rotation
     unsigned long step_delay; // delay between steps, in us, based on speed
+    long acceleration;        // ramp acceleration in steps/s^2, 0 for none
     int number_of_steps;      // total number of steps this motor can take
     int pin_count;            // how many pins are in use.
     int step_number;          // which step the motor is on
+    int phase;                // which phase table entry is energised
+    StepperDriveMode drive_mode; // wave, full or half step for 4 wire motors
 
     // motor pin numbers:
     int motor_pin_1;
@@ -123,6 +173,16 @@ class Stepper {
     int motor_pin_5;          // Only 5 phase motor
 
     unsigned long last_step_time; // timestamp in us of when the last step was taken
+
+    long position;            // steps taken, forward minus backward
+    long target_position;     // where tick() is headed
+    unsigned long tick_delay; // delay before tick()'s next step, in us
+    StepperRamp tick_ramp;    // tick()'s acceleration ramp
+    bool moving;              // tick() has a move under way
+
+    unsigned long hold_time;      // how long coils stay on after a step, in us, 0 for ever
+    unsigned long energised_time; // timestamp in us of when the coils were last driven
+    bool released;            // coils are off, the next stepNow() re-energises phase instead of stepping
 };
 
 #endif
@@ -0,0 +1,78 @@
+/*
+ * StepperRamp.cpp - Integer acceleration ramp for the Stepper library
+ */
+
+#include <math.h>
+
+#include "StepperRamp.h"
+
+/*
+ * 2 / (4n + 1) and 2 / (4n - 1) in Q16, built once at startup so the step
+ * path never divides. Index 0 is unused, the ramp index is at least 1 when
+ * either gets looked up.
+ */
+struct RampTables {
+    uint16_t accelerate[RAMP_TABLE_SIZE];
+    uint16_t decelerate[RAMP_TABLE_SIZE];
+
+    RampTables() {
+        accelerate[0] = decelerate[0] = 0;
+        for (uint32_t n = 1; n < RAMP_TABLE_SIZE; n++) {
+            accelerate[n] = (uint16_t)(((2UL << 16) + 2 * n) / (4 * n + 1));
+            decelerate[n] = (uint16_t)(((2UL << 16) + 2 * n) / (4 * n - 1));
+        }
+    }
+};
+
+static const RampTables tables;
+
+/*
+ * Splits a ramp index into a table slot and how far it had to be shifted
+ * down to fit.
+ */
+static inline uint32_t tableSlot(uint32_t n, uint8_t &shift) {
+    uint8_t bits = 32 - __builtin_clz(n);
+    shift = bits > RAMP_TABLE_BITS ? bits - RAMP_TABLE_BITS : 0;
+    return n >> shift;
+}
+
+void StepperRamp::begin(float acceleration, float velocity) {
+    // v^2 = 2 * a * n
+    this->ramp_index = 0;
+    if (acceleration > 0)
+        this->ramp_index = (uint32_t)(velocity * velocity / (2 * acceleration));
+
+    // the first ramp step is the slowest interval we can get back down to,
+    // from standstill it gets the 0.676 correction from AVR446
+    float slowest = 1000000.0f / velocity;
+    if (acceleration > 0)
+        slowest = 0.676f * sqrtf(2.0f / acceleration) * 1000000.0f;
+    if (!(slowest < 16000000.0f))
+        slowest = 16000000.0f;
+
+    // leave the top bit free so decelerating can't overflow
+    uint8_t bits = 32 - __builtin_clz((uint32_t)slowest | 1);
+    this->fraction_bits = 31 - bits;
+
+    float first = velocity > 0 ? 1000000.0f / velocity : slowest;
+    if (first > slowest)
+        first = slowest;
+    this->ramp_interval = (uint32_t)(first * (1UL << this->fraction_bits));
+}
+
+void StepperRamp::accelerate() {
+    uint8_t shift;
+    this->ramp_index++;
+    uint32_t slot = tableSlot(this->ramp_index, shift);
+    this->ramp_interval -= (uint32_t)(((uint64_t)this->ramp_interval * tables.accelerate[slot]) >> (16 + shift));
+}
+
+void StepperRamp::decelerate() {
+    if (this->ramp_index == 0)
+        return;
+
+    uint8_t shift;
+    uint32_t slot = tableSlot(this->ramp_index, shift);
+    this->ramp_interval += (uint32_t)(((uint64_t)this->ramp_interval * tables.decelerate[slot]) >> (16 + shift));
+    this->ramp_index--;
+}
@@ -0,0 +1,60 @@
+/*
+ * StepperRamp.h - Integer acceleration ramp for the Stepper library
+ *
+ * Works out successive step intervals for a constant acceleration ramp using
+ * the AVR446 recurrence
+ *
+ *   c[n] = c[n-1] * (4n - 1) / (4n + 1)
+ *
+ * without any sqrt or divide per step. The 2 / (4n + 1) and 2 / (4n - 1)
+ * factors are kept in Q16 tables, so a step costs one multiply and a shift.
+ * Past the end of the tables the ramp index is shifted down until it fits and
+ * the product is shifted back up by the same amount. That truncation adds up
+ * along the ramp: measured against the recurrence worked out exactly, the
+ * intervals stay within 0.2% over the first 16384 steps, 0.3% over 65536
+ * and 1.5% by 131072. Decelerating doesn't undo it, so a ramp back down
+ * from 65536 steps is off by up to 0.7%.
+ *
+ * Intervals are held in fixed point microseconds. begin() picks as many
+ * fraction bits as the slowest interval of the ramp leaves room for, so short
+ * intervals late in a fast ramp still change by a good number of units per
+ * step and rounding doesn't build up.
+ */
+
+// ensure this library description is only included once
+#ifndef StepperRamp_h
+#define StepperRamp_h
+
+#include <stdint.h>
+
+// log2 of the factor table length, 2^8 entries of each table is 1KB
+#define RAMP_TABLE_BITS 8
+#define RAMP_TABLE_SIZE (1 << RAMP_TABLE_BITS)
+
+class StepperRamp {
+  public:
+    // start a ramp for the given acceleration, in steps/s^2, at the given
+    // velocity in steps/s. This is the only place with a sqrt or a divide.
+    void begin(float acceleration, float velocity = 0);
+
+    // speeds up by one step
+    void accelerate();
+
+    // slows down by one step, never below the first ramp step
+    void decelerate();
+
+    // interval in us between steps at the current point of the ramp, rounded
+    uint32_t interval() {
+        return (this->ramp_interval + (1UL << this->fraction_bits >> 1)) >> this->fraction_bits;
+    }
+
+    // ramp index, the number of steps it takes to stop from here
+    uint32_t index() { return this->ramp_index; }
+
+  private:
+    uint32_t ramp_interval = 0; // current interval, us in fixed point
+    uint32_t ramp_index = 0;    // v^2 = 2 * a * n
+    uint8_t fraction_bits = 0;  // fixed point fraction bits of ramp_interval
+};
+
+#endif
@@ -0,0 +1,107 @@
+#include <math.h>
+
+#include "ArcInterpolator.h"
+
+//Chords between exact sin/cos corrections
+#define ARC_CORRECTION 12
+
+void ArcInterpolator::begin(const float start[AXIS_COUNT], const float end[AXIS_COUNT], float centreX, float centreY, bool clockwise) {
+    for (uint8_t i = 0; i < AXIS_COUNT; i++)
+        this->end[i] = end[i];
+
+    centre[0] = start[0] + centreX;
+    centre[1] = start[1] + centreY;
+    radiusVector[0] = -centreX;
+    radiusVector[1] = -centreY;
+
+    radius = sqrtf(centreX * centreX + centreY * centreY);
+    float endX = end[0] - centre[0];
+    float endY = end[1] - centre[1];
+
+    //Angle swept from start to end, in the direction of travel
+    float travel = atan2f(radiusVector[0] * endY - radiusVector[1] * endX, radiusVector[0] * endX + radiusVector[1] * endY);
+    if (clockwise) {
+        if (travel >= -1e-6f)
+            travel -= 2 * (float)M_PI;
+    } else {
+        if (travel <= 1e-6f)
+            travel += 2 * (float)M_PI;
+    }
+
+    //Largest chord angle that stays within tolerance of the arc
+    float maxAngle = (float)M_PI / 2;
+    if (radius > tolerance)
+        maxAngle = 2 * acosf(1 - tolerance / radius);
+
+    chords = (uint32_t)ceilf(fabsf(travel) / maxAngle);
+    if (chords == 0)
+        chords = 1;
+
+    startAngle = atan2f(radiusVector[1], radiusVector[0]);
+    angle = travel / chords;
+    cosAngle = cosf(angle);
+    sinAngle = sinf(angle);
+
+    z = start[2];
+    zStep = (end[2] - start[2]) / chords;
+
+    remaining = chords;
+}
+
+void ArcInterpolator::beginRadius(const float start[AXIS_COUNT], const float end[AXIS_COUNT], float radius, bool clockwise) {
+    float centreX;
+    float centreY;
+    centreFromRadius(start, end, radius, clockwise, centreX, centreY);
+
+    begin(start, end, centreX, centreY, clockwise);
+}
+
+void ArcInterpolator::centreFromRadius(const float start[AXIS_COUNT], const float end[AXIS_COUNT], float radius, bool clockwise, float &centreX, float &centreY) {
+    float x = end[0] - start[0];
+    float y = end[1] - start[1];
+
+    //Centre sits on the perpendicular bisector of start to end
+    float distanceSqr = x * x + y * y;
+    float offset = 4 * radius * radius - distanceSqr;
+    offset = offset > 0 && distanceSqr > 0 ? -sqrtf(offset / distanceSqr) : 0;
+    if (!clockwise)
+        offset = -offset;
+    if (radius < 0)
+        offset = -offset;
+
+    centreX = 0.5f * (x - y * offset);
+    centreY = 0.5f * (y + x * offset);
+}
+
+bool ArcInterpolator::next(int32_t target[AXIS_COUNT]) {
+    if (remaining == 0)
+        return false;
+
+    remaining--;
+    uint32_t done = chords - remaining;
+
+    if (remaining == 0) {
+        //Land exactly on the requested end
+        for (uint8_t i = 0; i < AXIS_COUNT; i++)
+            target[i] = (int32_t)lroundf(end[i]);
+        return true;
+    }
+
+    if (done % ARC_CORRECTION == 0) {
+        float exact = startAngle + angle * done;
+        radiusVector[0] = radius * cosf(exact);
+        radiusVector[1] = radius * sinf(exact);
+    } else {
+        float x = radiusVector[0] * cosAngle - radiusVector[1] * sinAngle;
+        radiusVector[1] = radiusVector[0] * sinAngle + radiusVector[1] * cosAngle;
+        radiusVector[0] = x;
+    }
+
+    z += zStep;
+
+    target[0] = (int32_t)lroundf(centre[0] + radiusVector[0]);
+    target[1] = (int32_t)lroundf(centre[1] + radiusVector[1]);
+    target[2] = (int32_t)lroundf(z);
+
+    return true;
+}
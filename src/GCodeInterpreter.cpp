@@ -0,0 +1,274 @@
+#include "GCodeInterpreter.h"
+#include "ArcInterpolator.h"
+
+static bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+//Parse a decimal number, advancing p past it. No exponents, G-code doesn't use them.
+static bool parseNumber(const char *&p, float &value) {
+    bool negative = false;
+    if (*p == '-' || *p == '+') {
+        negative = *p == '-';
+        p++;
+    }
+
+    if (!isDigit(*p) && *p != '.')
+        return false;
+
+    uint32_t whole = 0;
+    while (isDigit(*p))
+        whole = whole * 10 + (*p++ - '0');
+
+    uint32_t fraction = 0;
+    uint32_t divisor = 1;
+    if (*p == '.') {
+        p++;
+        while (isDigit(*p)) {
+            //Anything past 7 places is below float precision anyway
+            if (divisor < 10000000) {
+                fraction = fraction * 10 + (*p - '0');
+                divisor *= 10;
+            }
+            p++;
+        }
+    }
+
+    value = whole + (float)fraction / divisor;
+    if (negative)
+        value = -value;
+
+    return true;
+}
+
+GCodeStatus GCodeInterpreter::feed(char c) {
+    if (pending)
+        return GCODE_PENDING;
+
+    if (c == '\r')
+        return GCODE_INCOMPLETE;
+
+    if (c != '\n') {
+        if (length < GCODE_LINE_LENGTH)
+            line[length++] = c;
+        else
+            overflow = true;
+
+        return GCODE_INCOMPLETE;
+    }
+
+    line[length] = '\0';
+    GCodeStatus status = overflow ? GCODE_ERROR_OVERFLOW : parseLine();
+    length = 0;
+    overflow = false;
+
+    if (status != GCODE_OK)
+        return status;
+
+    status = execute();
+    pending = status == GCODE_PENDING;
+
+    return status;
+}
+
+GCodeStatus GCodeInterpreter::poll() {
+    if (!pending)
+        return GCODE_INCOMPLETE;
+
+    GCodeStatus status = execute();
+    pending = status == GCODE_PENDING;
+
+    return status;
+}
+
+GCodeStatus GCodeInterpreter::parseLine() {
+    words = Words();
+
+    //Checksum is the XOR of everything before the '*'
+    bool checksummed = false;
+    for (char *p = line; *p; p++) {
+        if (*p != '*')
+            continue;
+
+        uint8_t sum = 0;
+        for (char *q = line; q < p; q++)
+            sum ^= (uint8_t)*q;
+
+        const char *number = p + 1;
+        float expected;
+        if (!parseNumber(number, expected) || (uint8_t)expected != sum)
+            return GCODE_ERROR_CHECKSUM;
+
+        *p = '\0';
+        checksummed = true;
+        break;
+    }
+
+    //A G number the switch in execute() can't tell apart once it's been cut down to a byte
+    bool unsupported = false;
+
+    const char *p = line;
+    while (*p) {
+        char letter = *p;
+        if (letter == ' ' || letter == '\t') {
+            p++;
+            continue;
+        }
+
+        if (letter == ';')
+            break;
+
+        if (letter == '(') {
+            while (*p && *p != ')')
+                p++;
+            if (*p)
+                p++;
+            continue;
+        }
+
+        if (letter >= 'a' && letter <= 'z')
+            letter -= 'a' - 'A';
+        if (letter < 'A' || letter > 'Z')
+            return GCODE_ERROR_SYNTAX;
+
+        p++;
+        float value;
+        if (!parseNumber(p, value))
+            return GCODE_ERROR_SYNTAX;
+
+        //G can show up more than once, keep every one of them. G28.1 or G284 would be cut down
+        //to G28, so anything that isn't a whole number that fits is turned away instead.
+        if (letter == 'G') {
+            if (value < 0 || value > 255 || value != (float)(uint8_t)value)
+                unsupported = true;
+            else if (words.gCount == GCODE_MAX_G_WORDS)
+                return GCODE_ERROR_SYNTAX;
+            else
+                words.gCodes[words.gCount++] = (uint8_t)value;
+        }
+
+        words.seen |= 1UL << (letter - 'A');
+        words.values[letter - 'A'] = value;
+    }
+
+    //Blank or comment only
+    if (words.seen == 0 || words.seen == (1UL << ('N' - 'A')))
+        return checksummed ? GCODE_ERROR_SYNTAX : GCODE_INCOMPLETE;
+
+    if (words.has('N')) {
+        int32_t number = (int32_t)words.get('N');
+
+        //M110 resets the line number rather than following it
+        if (words.has('M') && (uint16_t)words.get('M') == 110) {
+            lineNumber = number;
+            return GCODE_OK;
+        }
+
+        if (number != lineNumber + 1)
+            return GCODE_ERROR_LINE_NUMBER;
+
+        lineNumber = number;
+    }
+
+    //Refused after the line number is taken, so the host's numbering carries on past it
+    if (unsupported)
+        return GCODE_ERROR_UNSUPPORTED;
+
+    return GCODE_OK;
+}
+
+GCodeStatus GCodeInterpreter::execute() {
+    //Everything before the machine call has to be safe to repeat, a pending line runs again
+
+    if (words.has('M')) {
+        uint16_t code = (uint16_t)words.get('M');
+        if (code != 110 && !machine.mCode(code, words.has('S'), words.get('S')))
+            return GCODE_PENDING;
+
+        linesProcessed++;
+        return GCODE_OK;
+    }
+
+    //Check every G word before any of them changes a mode, "G91 G99" is refused whole
+    for (uint8_t i = 0; i < words.gCount; i++) {
+        switch (words.gCodes[i]) {
+            case 0:
+            case 1:
+            case 2:
+            case 3:
+            case 17:
+            case 28:
+            case 90:
+            case 91:
+                break;
+            default:
+                return GCODE_ERROR_UNSUPPORTED;
+        }
+    }
+
+    if (words.has('F'))
+        feedRate = words.get('F') / 60;
+
+    for (uint8_t i = 0; i < words.gCount; i++) {
+        uint8_t code = words.gCodes[i];
+        switch (code) {
+            case 0:
+            case 1:
+            case 2:
+            case 3:
+                motionMode = code;
+                break;
+            case 17: //XY plane, the only one arcs run in
+                break;
+            case 28:
+                if (!machine.home())
+                    return GCODE_PENDING;
+                linesProcessed++;
+                return GCODE_OK;
+            case 90:
+                relative = false;
+                break;
+            case 91:
+                relative = true;
+                break;
+        }
+    }
+
+    const char axisLetters[AXIS_COUNT] = {'X', 'Y', 'Z'};
+    bool moving = false;
+    float start[AXIS_COUNT];
+    float target[AXIS_COUNT];
+    for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+        start[i] = machine.getPosition(i);
+        target[i] = start[i];
+
+        if (words.has(axisLetters[i])) {
+            target[i] = relative ? start[i] + words.get(axisLetters[i]) : words.get(axisLetters[i]);
+            moving = true;
+        }
+    }
+
+    if (moving) {
+        bool accepted;
+        if (motionMode == 0) {
+            accepted = machine.line(target, 0);
+        } else if (motionMode == 1) {
+            accepted = machine.line(target, feedRate);
+        } else {
+            float centreX = words.get('I');
+            float centreY = words.get('J');
+            if (words.has('R'))
+                ArcInterpolator::centreFromRadius(start, target, words.get('R'), motionMode == 2, centreX, centreY);
+            else if (!words.has('I') && !words.has('J'))
+                return GCODE_ERROR_SYNTAX;
+
+            accepted = machine.arc(target, centreX, centreY, motionMode == 2, feedRate);
+        }
+
+        if (!accepted)
+            return GCODE_PENDING;
+    }
+
+    linesProcessed++;
+    return GCODE_OK;
+}
@@ -0,0 +1,140 @@
+#include "Homing.h"
+
+static volatile bool interruptPending = false;
+
+static void IRAM_ATTR onSwitchInterrupt() {
+    interruptPending = true;
+}
+
+void Homing::begin(Adafruit_MCP23X17 &mcp, uint8_t interruptPin, StepCallback onStep) {
+    this->mcp = &mcp;
+    this->interruptPin = interruptPin;
+    this->onStep = onStep;
+
+    //Mirror INTA and INTB so either can be wired, driven low while an interrupt is pending
+    mcp.setupInterrupts(true, false, LOW);
+    pinMode(interruptPin, INPUT);
+}
+
+void Homing::setAxis(uint8_t axis, uint8_t minPin, uint8_t maxPin, uint32_t stepInterval) {
+    if (axis >= AXIS_COUNT)
+        return;
+
+    axes[axis].pins[0] = minPin;
+    axes[axis].pins[1] = maxPin;
+    axes[axis].interval = stepInterval;
+}
+
+//Start a phase, the switch is armed to interrupt while it's closed
+void Homing::arm(Axis &axis, Phase phase, uint32_t now) {
+    axis.phase = phase;
+    axis.nextStep = now;
+    mcp->setupInterruptPin(axis.pin, LOW);
+}
+
+void Homing::touched(Axis &axis, uint32_t now) {
+    mcp->disableInterruptPin(axis.pin);
+
+    if (axis.phase == PHASE_SLOW) {
+        if (axis.touches == 0)
+            axis.firstTouch = axis.position;
+
+        int32_t offset = abs(axis.position - axis.firstTouch);
+        if (offset > axis.spread)
+            axis.spread = offset;
+
+        axis.touches++;
+        if (axis.touches >= HOMING_TOUCHES) {
+            axis.phase = PHASE_DONE;
+            return;
+        }
+    }
+
+    axis.phase = PHASE_BACK_OFF;
+    axis.backOff = HOMING_BACKOFF_STEPS;
+    axis.nextStep = now;
+}
+
+void Homing::step(uint8_t index, bool forward, uint32_t now) {
+    Axis &axis = axes[index];
+
+    //Released coils wake on this one, the step goes again at the next interval
+    if (!onStep(index, forward))
+        return;
+    axis.position += forward ? 1 : -1;
+
+    //Only progress towards the switch counts, backing off between touches doesn't
+    int32_t progress = axis.forward ? axis.position : -axis.position;
+    if (progress > (int32_t)maxSteps) {
+        mcp->disableInterruptPin(axis.pin);
+        axis.phase = PHASE_FAILED;
+        return;
+    }
+
+    if (axis.phase == PHASE_BACK_OFF && --axis.backOff == 0)
+        arm(axis, PHASE_SLOW, now);
+}
+
+bool Homing::run(bool toMax, uint32_t maxSteps) {
+    this->maxSteps = maxSteps;
+    uint32_t started = millis();
+    uint32_t now = micros();
+
+    for (Axis &axis : axes) {
+        axis.pin = axis.pins[toMax ? 1 : 0];
+        axis.forward = toMax;
+        axis.position = 0;
+        axis.spread = 0;
+        axis.touches = 0;
+        arm(axis, PHASE_FAST, now);
+    }
+
+    //A switch that's already closed pulled the line low before we were listening for the edge
+    attachInterrupt(digitalPinToInterrupt(interruptPin), onSwitchInterrupt, FALLING);
+    interruptPending = digitalRead(interruptPin) == LOW;
+
+    bool running = true;
+    while (running) {
+        now = micros();
+
+        //Only touch the bus once a switch has actually closed. Reading the capture clears the
+        //interrupt, a switch that closed in the meantime keeps it asserted.
+        if (interruptPending) {
+            interruptPending = false;
+            uint16_t captured = mcp->getCapturedInterrupt();
+
+            for (Axis &axis : axes) {
+                bool approaching = axis.phase == PHASE_FAST || axis.phase == PHASE_SLOW;
+                if (approaching && !(captured & (1 << axis.pin)))
+                    touched(axis, now);
+            }
+
+            //The MCP holds the line down while any armed switch stays closed, there's no new edge for it
+            if (digitalRead(interruptPin) == LOW)
+                interruptPending = true;
+        }
+
+        running = false;
+        for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+            Axis &axis = axes[i];
+            if (axis.phase == PHASE_DONE || axis.phase == PHASE_FAILED)
+                continue;
+
+            running = true;
+            if ((int32_t)(now - axis.nextStep) < 0)
+                continue;
+
+            axis.nextStep += axis.phase == PHASE_SLOW ? axis.interval * HOMING_SLOW_FACTOR : axis.interval;
+            step(i, axis.phase == PHASE_BACK_OFF ? !axis.forward : axis.forward, now);
+        }
+    }
+
+    detachInterrupt(digitalPinToInterrupt(interruptPin));
+    duration = millis() - started;
+
+    bool homed = true;
+    for (Axis &axis : axes)
+        homed = homed && axis.phase == PHASE_DONE;
+
+    return homed;
+}
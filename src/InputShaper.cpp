@@ -0,0 +1,90 @@
+#include <math.h>
+
+#include "InputShaper.h"
+
+bool InputShaper::configure(ShaperType type, float frequency, float damping, uint32_t tickUs) {
+    impulses = 1;
+    delays[0] = 0;
+    amplitudes[0] = 1UL << 16;
+
+    if (type == SHAPER_NONE || frequency <= 0)
+        return true;
+
+    //Damped period of the ringing, and how much it dies down over half of one
+    float root = sqrtf(1 - damping * damping);
+    float period = 1 / (frequency * root);
+    float k = expf(-damping * (float)M_PI / root);
+
+    float weights[SHAPER_MAX_IMPULSES];
+    float times[SHAPER_MAX_IMPULSES];
+    uint8_t count;
+    if (type == SHAPER_ZV) {
+        count = 2;
+        weights[0] = 1;
+        weights[1] = k;
+        times[0] = 0;
+        times[1] = 0.5f * period;
+    } else if (type == SHAPER_ZVD) {
+        count = 3;
+        weights[0] = 1;
+        weights[1] = 2 * k;
+        weights[2] = k * k;
+        times[0] = 0;
+        times[1] = 0.5f * period;
+        times[2] = period;
+    } else {
+        float mk = expf(-0.75f * damping * (float)M_PI / root);
+        float a1 = 1 - 1 / sqrtf(2);
+        count = 3;
+        weights[0] = a1;
+        weights[1] = (sqrtf(2) - 1) * mk;
+        weights[2] = a1 * mk * mk;
+        times[0] = 0;
+        times[1] = 0.375f * period;
+        times[2] = 0.75f * period;
+    }
+
+    uint32_t longest = (uint32_t)lroundf(times[count - 1] * 1000000 / tickUs);
+    if (longest >= SHAPER_HISTORY)
+        return false;
+
+    float sum = 0;
+    for (uint8_t i = 0; i < count; i++)
+        sum += weights[i];
+
+    //Whatever rounding leaves over goes on the first impulse so they add up to exactly 1
+    uint32_t total = 0;
+    for (uint8_t i = count; i-- > 0;) {
+        delays[i] = (uint16_t)lroundf(times[i] * 1000000 / tickUs);
+        amplitudes[i] = i == 0 ? (1UL << 16) - total : (uint32_t)lroundf(weights[i] / sum * (1UL << 16));
+        total += amplitudes[i];
+    }
+
+    impulses = count;
+    return true;
+}
+
+void InputShaper::reset(int32_t position) {
+    for (uint16_t i = 0; i < SHAPER_HISTORY; i++)
+        history[i] = position;
+    settle = 0;
+}
+
+int32_t InputShaper::shape(int32_t position) {
+    uint16_t last = (head + SHAPER_HISTORY - 1) % SHAPER_HISTORY;
+    if (position != history[last])
+        settle = delays[impulses - 1] + 1;
+    else if (settle > 0)
+        settle--;
+
+    history[head] = position;
+
+    int64_t shaped = 0;
+    for (uint8_t i = 0; i < impulses; i++)
+        shaped += (int64_t)history[(head + SHAPER_HISTORY - delays[i]) % SHAPER_HISTORY] * amplitudes[i];
+
+    head = (head + 1) % SHAPER_HISTORY;
+
+    //Round to the nearest step
+    return (int32_t)((shaped + (1 << 15)) >> 16);
+}
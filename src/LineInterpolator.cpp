@@ -0,0 +1,38 @@
+#include "LineInterpolator.h"
+
+void LineInterpolator::begin(const int32_t delta[AXIS_COUNT]) {
+    events = 0;
+    forwardMask = 0;
+    for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+        counts[i] = delta[i] < 0 ? -delta[i] : delta[i];
+        if (delta[i] > 0)
+            forwardMask |= 1 << i;
+
+        if (counts[i] > events)
+            events = counts[i];
+    }
+
+    //Start every error term half way so minor axis steps land in the middle of their span
+    for (uint8_t i = 0; i < AXIS_COUNT; i++)
+        errors[i] = events / 2;
+
+    remaining = events;
+}
+
+uint8_t LineInterpolator::next() {
+    if (remaining == 0)
+        return 0;
+
+    uint8_t stepMask = 0;
+    for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+        errors[i] -= counts[i];
+        if (errors[i] < 0) {
+            errors[i] += events;
+            stepMask |= 1 << i;
+        }
+    }
+
+    remaining--;
+
+    return stepMask;
+}
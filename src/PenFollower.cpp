@@ -0,0 +1,44 @@
+#include "PenFollower.h"
+
+void PenFollower::reset() {
+    speed = 0;
+    gated = false;
+    primed = false;
+    retracting = false;
+    followed = false;
+}
+
+PenAction PenFollower::follow(uint32_t now, float velocity, bool toolOn, uint32_t untilChange) {
+    float acceleration = 0;
+    if (followed && now > lastFollow)
+        acceleration = (velocity - lastVelocity) * 1000 / (now - lastFollow);
+    lastVelocity = velocity;
+    lastFollow = now;
+    followed = true;
+
+    //The filament lags the motor, so whatever changes within leadTime gets started now
+    bool changing = untilChange < leadTime * 1000;
+    if (toolOn && !changing) {
+        speed = flow * (velocity + advance * acceleration);
+        gated = velocity >= PEN_MIN_FEED;
+    } else if (!toolOn && changing) {
+        //Prime ahead of a line that extrudes
+        speed = flow * PEN_NOMINAL_FEED;
+        gated = true;
+    } else {
+        //Pull back once for leadTime after feeding, then leave it
+        if (primed) {
+            primed = false;
+            retracting = true;
+            retractStarted = now;
+        } else if (retracting && now - retractStarted >= leadTime) {
+            retracting = false;
+        }
+
+        return retracting ? PEN_RETRACT : PEN_HOLD;
+    }
+
+    primed = true;
+    retracting = false;
+    return PEN_FEED;
+}
@@ -0,0 +1,106 @@
+#include <math.h>
+
+#include "Planner.h"
+
+float Planner::pathAcceleration(const Segment &segment) {
+    float acceleration = segment.acceleration * segment.length / segment.events;
+
+    //S-curves need more room than a constant acceleration ramp, be conservative
+    if (segment.mode == PROFILE_SCURVE)
+        acceleration /= 2;
+
+    return acceleration;
+}
+
+void Planner::prepare(Segment &segment, bool queueEmpty) {
+    float unit[AXIS_COUNT];
+    for (uint8_t i = 0; i < AXIS_COUNT; i++)
+        unit[i] = segment.delta[i] / segment.length;
+
+    float nominalSpeed = segment.maxVelocity * segment.length / segment.events;
+    float nominalSpeedSqr = nominalSpeed * nominalSpeed;
+
+    segment.maxEntrySpeedSqr = 0;
+    if (hasPrevious) {
+        //cos of the angle between the two moves, -1 is straight on and 1 a full reversal
+        float cosTheta = 0;
+        for (uint8_t i = 0; i < AXIS_COUNT; i++)
+            cosTheta -= previousUnit[i] * unit[i];
+
+        if (cosTheta < 0.999999f) {
+            float limit = nominalSpeedSqr < previousSpeedSqr ? nominalSpeedSqr : previousSpeedSqr;
+
+            if (cosTheta < -0.999999f) {
+                segment.maxEntrySpeedSqr = limit;
+            } else {
+                //v^2 = a * d * sin(theta / 2) / (1 - sin(theta / 2))
+                float sinHalfTheta = sqrtf(0.5f * (1 - cosTheta));
+                float junctionSqr = pathAcceleration(segment) * junctionDeviation * sinHalfTheta / (1 - sinHalfTheta);
+                segment.maxEntrySpeedSqr = junctionSqr < limit ? junctionSqr : limit;
+            }
+        }
+    }
+
+    //With nothing queued the move in progress is already heading for a stop
+    segment.entrySpeedSqr = 0;
+    if (queueEmpty)
+        segment.maxEntrySpeedSqr = 0;
+
+    hasPrevious = true;
+    previousSpeedSqr = nominalSpeedSqr;
+    for (uint8_t i = 0; i < AXIS_COUNT; i++)
+        previousUnit[i] = unit[i];
+}
+
+void Planner::recalculate(SegmentQueue &queue) {
+    uint8_t depth = queue.getDepth();
+    if (depth < 2) {
+        planned = 0;
+        return;
+    }
+
+    //Backward pass, the last segment has to be able to stop
+    uint8_t index = depth - 1;
+    Segment *current = &queue.at(index);
+    float stopSqr = 2 * pathAcceleration(*current) * current->length;
+    current->entrySpeedSqr = current->maxEntrySpeedSqr < stopSqr ? current->maxEntrySpeedSqr : stopSqr;
+
+    while (--index > planned) {
+        Segment *next = current;
+        current = &queue.at(index);
+
+        if (current->entrySpeedSqr != current->maxEntrySpeedSqr) {
+            float entrySqr = next->entrySpeedSqr + 2 * pathAcceleration(*current) * current->length;
+            current->entrySpeedSqr = current->maxEntrySpeedSqr < entrySqr ? current->maxEntrySpeedSqr : entrySqr;
+        }
+    }
+
+    //Forward pass, nobody can enter faster than the segment before can accelerate to
+    Segment *next = &queue.at(planned);
+    for (index = planned + 1; index < depth; index++) {
+        current = next;
+        next = &queue.at(index);
+
+        if (current->entrySpeedSqr < next->entrySpeedSqr) {
+            float entrySqr = current->entrySpeedSqr + 2 * pathAcceleration(*current) * current->length;
+            if (entrySqr < next->entrySpeedSqr) {
+                next->entrySpeedSqr = entrySqr;
+                //Acceleration limited all the way here, nothing behind can do better
+                planned = index;
+            }
+        }
+
+        if (next->entrySpeedSqr == next->maxEntrySpeedSqr)
+            planned = index;
+    }
+}
+
+void Planner::onPop() {
+    if (planned > 0)
+        planned--;
+}
+
+void Planner::reset() {
+    hasPrevious = false;
+    planned = 0;
+}
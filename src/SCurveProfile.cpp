@@ -0,0 +1,137 @@
+#include <math.h>
+
+#include "SCurveProfile.h"
+
+//Time to change velocity by the given amount with the given limits
+static float rampTimeFor(float change, float acceleration, float jerk) {
+    if (change <= 0)
+        return 0;
+
+    if (change >= acceleration * acceleration / jerk)
+        return change / acceleration + acceleration / jerk;
+
+    return 2 * sqrtf(change / jerk);
+}
+
+//Steps covered getting from entry up to cruise and back down to exit. Each ramp is
+//point symmetric so it covers the average of its two velocities times its duration.
+static float rampStepsFor(float entry, float cruise, float exit, float acceleration, float jerk) {
+    return (entry + cruise) / 2 * rampTimeFor(cruise - entry, acceleration, jerk)
+        + (cruise + exit) / 2 * rampTimeFor(cruise - exit, acceleration, jerk);
+}
+
+void SCurveProfile::Ramp::plan(float change, float acceleration, float jerk) {
+    this->change = change;
+
+    if (change <= 0) {
+        jerkTime = constantTime = peakAcceleration = time = 0;
+        return;
+    }
+
+    if (change >= acceleration * acceleration / jerk) {
+        peakAcceleration = acceleration;
+        jerkTime = acceleration / jerk;
+        constantTime = change / acceleration - jerkTime;
+    } else {
+        jerkTime = sqrtf(change / jerk);
+        peakAcceleration = jerk * jerkTime;
+        constantTime = 0;
+    }
+
+    time = 2 * jerkTime + constantTime;
+}
+
+float SCurveProfile::Ramp::velocityAt(float t, float jerk) {
+    if (t <= 0)
+        return 0;
+
+    if (t < jerkTime)
+        return 0.5f * jerk * t * t;
+
+    if (t < jerkTime + constantTime)
+        return 0.5f * peakAcceleration * jerkTime + peakAcceleration * (t - jerkTime);
+
+    if (t < time) {
+        float left = time - t;
+        return change - 0.5f * jerk * left * left;
+    }
+
+    return change;
+}
+
+void SCurveProfile::begin(uint32_t steps, float entryVelocity, float maxVelocity, float exitVelocity, float acceleration, float jerk) {
+    this->jerk = jerk;
+    this->entryVelocity = entryVelocity < maxVelocity ? entryVelocity : maxVelocity;
+    this->exitVelocity = exitVelocity < maxVelocity ? exitVelocity : maxVelocity;
+    total = steps;
+    step = 0;
+    time = 0;
+    decelerating = false;
+
+    //If there isn't room to get to full speed and back, search for the cruise velocity that fits
+    float lowest = this->entryVelocity > this->exitVelocity ? this->entryVelocity : this->exitVelocity;
+    cruiseVelocity = maxVelocity;
+    if (rampStepsFor(this->entryVelocity, cruiseVelocity, this->exitVelocity, acceleration, jerk) > total) {
+        float low = lowest;
+        float high = maxVelocity;
+        for (int i = 0; i < 16; i++) {
+            float mid = (low + high) / 2;
+            if (rampStepsFor(this->entryVelocity, mid, this->exitVelocity, acceleration, jerk) > total)
+                high = mid;
+            else
+                low = mid;
+        }
+        cruiseVelocity = low;
+    }
+
+    accelRamp.plan(cruiseVelocity - this->entryVelocity, acceleration, jerk);
+    decelRamp.plan(cruiseVelocity - this->exitVelocity, acceleration, jerk);
+
+    accelSteps = (uint32_t)((this->entryVelocity + cruiseVelocity) / 2 * accelRamp.time);
+    decelSteps = (uint32_t)((cruiseVelocity + this->exitVelocity) / 2 * decelRamp.time);
+    if (decelSteps > total)
+        decelSteps = total;
+
+    //From standstill the first step takes j * t^3 / 6 = 1
+    float firstInterval = cbrtf(6.0f / jerk);
+
+    //Steps at the standstill end of a ramp are capped, but never below the slowest speed the move plans
+    float slowest = cruiseVelocity;
+    if (this->entryVelocity > 0 && this->entryVelocity < slowest)
+        slowest = this->entryVelocity;
+    if (this->exitVelocity > 0 && this->exitVelocity < slowest)
+        slowest = this->exitVelocity;
+
+    rampInterval = firstInterval;
+    if (slowest > 0 && 1 / slowest > rampInterval)
+        rampInterval = 1 / slowest;
+}
+
+uint32_t SCurveProfile::next() {
+    step++;
+
+    //Decelerate by walking back down the decel ramp
+    if (!decelerating && step + decelSteps >= total) {
+        decelerating = true;
+        time = decelRamp.time;
+    }
+
+    float velocity;
+    if (decelerating)
+        velocity = exitVelocity + decelRamp.velocityAt(time, jerk);
+    else
+        velocity = entryVelocity + accelRamp.velocityAt(time, jerk);
+
+    //Cruise runs at whatever speed was planned, however slow
+    bool cruising = !decelerating && time >= accelRamp.time;
+    float interval = velocity > 0 ? 1 / velocity : rampInterval;
+    if (!cruising && interval > rampInterval)
+        interval = rampInterval;
+
+    if (decelerating)
+        time -= interval;
+    else if (time < accelRamp.time)
+        time += interval;
+
+    return (uint32_t)(interval * 1000000.0f);
+}
@@ -0,0 +1,79 @@
+#include "SegmentMerger.h"
+
+bool SegmentMerger::add(const int32_t from[AXIS_COUNT], const int32_t target[AXIS_COUNT], float feedRate) {
+    const int32_t *last = held > 0 ? ends[held - 1] : from;
+
+    bool moves = false;
+    for (uint8_t i = 0; i < AXIS_COUNT; i++)
+        moves = moves || target[i] != last[i];
+
+    if (!moves) {
+        folded++;
+        return true;
+    }
+
+    if (held == 0) {
+        for (uint8_t i = 0; i < AXIS_COUNT; i++)
+            start[i] = from[i];
+    } else if (!fits(target) || feedRate != this->feedRate) {
+        return false;
+    } else {
+        merged++;
+    }
+
+    for (uint8_t i = 0; i < AXIS_COUNT; i++)
+        ends[held][i] = target[i];
+    held++;
+    this->feedRate = feedRate;
+    return true;
+}
+
+//Whether the line from start to target stays close enough to every held end
+bool SegmentMerger::fits(const int32_t target[AXIS_COUNT]) {
+    if (held >= MERGE_MAX_MOVES)
+        return false;
+
+    float line[AXIS_COUNT];
+    float lengthSqr = 0;
+    float forward = 0;
+    for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+        line[i] = (float)(target[i] - start[i]);
+        lengthSqr += line[i] * line[i];
+        forward += (float)(ends[held - 1][i] - start[i]) * (target[i] - ends[held - 1][i]);
+    }
+
+    //Turning back on ourselves can still be within tolerance of the line, but it isn't the same move
+    if (forward <= 0)
+        return false;
+
+    //Distance from the line is |p x line| / |line|, compared squared to keep the sqrt out
+    for (uint8_t n = 0; n < held; n++) {
+        float point[AXIS_COUNT];
+        for (uint8_t i = 0; i < AXIS_COUNT; i++)
+            point[i] = (float)(ends[n][i] - start[i]);
+
+        float crossSqr = 0;
+        for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+            uint8_t a = (i + 1) % AXIS_COUNT;
+            uint8_t b = (i + 2) % AXIS_COUNT;
+            float cross = point[a] * line[b] - point[b] * line[a];
+            crossSqr += cross * cross;
+        }
+
+        if (crossSqr > tolerance * tolerance * lengthSqr)
+            return false;
+    }
+
+    return true;
+}
+
+bool SegmentMerger::take(int32_t target[AXIS_COUNT], float &feedRate) {
+    if (held == 0)
+        return false;
+
+    for (uint8_t i = 0; i < AXIS_COUNT; i++)
+        target[i] = ends[held - 1][i];
+    feedRate = this->feedRate;
+    held = 0;
+    return true;
+}
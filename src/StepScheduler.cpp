@@ -0,0 +1,517 @@
+#include <math.h>
+
+#include "StepScheduler.h"
+
+#ifdef ARDUINO
+static portMUX_TYPE schedulerMux = portMUX_INITIALIZER_UNLOCKED;
+#define SCHEDULER_LOCK() portENTER_CRITICAL(&schedulerMux)
+#define SCHEDULER_UNLOCK() portEXIT_CRITICAL(&schedulerMux)
+#else
+#define SCHEDULER_LOCK()
+#define SCHEDULER_UNLOCK()
+#endif
+
+StepScheduler Scheduler;
+
+void StepScheduler::attach(StepCallback callback) {
+    onStep = callback;
+}
+
+void StepScheduler::attachTick(TickCallback callback) {
+    onTick = callback;
+}
+
+#ifdef ARDUINO
+static hw_timer_t *stepTimer = NULL;
+static TaskHandle_t stepTask = NULL;
+
+static void IRAM_ATTR onStepTimer() {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(stepTask, &woken);
+    if (woken)
+        portYIELD_FROM_ISR();
+}
+
+static void stepTaskLoop(void *arg) {
+    for (;;) {
+        //Ticks that arrive while we're busy stepping are collapsed into one
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        Scheduler.tick(micros());
+    }
+}
+
+void StepScheduler::begin() {
+    xTaskCreatePinnedToCore(stepTaskLoop, "steps", 4096, NULL, configMAX_PRIORITIES - 1, &stepTask, MOTION_CORE);
+
+    //The timer interrupt is allocated on the core that starts it, keep it next to the task it wakes.
+    //80 divider for microsecond precision @80MHz clock, count_up = true
+    stepTimer = timerBegin(STEP_TIMER, 80, true);
+    timerAttachInterrupt(stepTimer, &onStepTimer, true);
+    timerAlarmWrite(stepTimer, STEP_TICK_US, true);
+    timerAlarmEnable(stepTimer);
+}
+#else
+void StepScheduler::run(uint32_t us) {
+    uint32_t end = virtualTime + us;
+    while ((int32_t)(end - virtualTime) > 0) {
+        virtualTime += STEP_TICK_US;
+        tick(virtualTime);
+    }
+}
+#endif
+
+void StepScheduler::setLimits(uint8_t axis, float maxVelocity, float acceleration, float jerk) {
+    if (axis >= AXIS_COUNT)
+        return;
+
+    maxVelocities[axis] = maxVelocity;
+    accelerations[axis] = acceleration;
+    jerks[axis] = jerk;
+    minIntervals[axis] = maxVelocity > 0 ? 1000000 / maxVelocity : 0;
+}
+
+void StepScheduler::setBacklash(uint8_t axis, uint32_t steps) {
+    if (axis >= AXIS_COUNT)
+        return;
+
+    SCHEDULER_LOCK();
+    backlash[axis] = steps;
+    takeUp[axis] = 0;
+    SCHEDULER_UNLOCK();
+}
+
+void StepScheduler::setDirection(uint8_t axis, bool forward) {
+    if (axis >= AXIS_COUNT)
+        return;
+
+    SCHEDULER_LOCK();
+    if (forward)
+        directionMask |= 1 << axis;
+    else
+        directionMask &= ~(1 << axis);
+    takeUp[axis] = 0;
+    SCHEDULER_UNLOCK();
+}
+
+bool StepScheduler::setShaper(uint8_t axis, ShaperType type, float frequency, float damping) {
+    if (axis >= SHAPED_AXES)
+        return type == SHAPER_NONE;
+
+    SCHEDULER_LOCK();
+    bool fits = shapers[axis].configure(type, frequency, damping, STEP_TICK_US);
+    shapers[axis].reset(positions[axis]);
+    shapedPositions[axis] = positions[axis];
+    SCHEDULER_UNLOCK();
+
+    return fits;
+}
+
+void StepScheduler::setFeedOverride(int32_t percent) {
+    if (percent < FEED_OVERRIDE_MIN)
+        percent = FEED_OVERRIDE_MIN;
+    if (percent > FEED_OVERRIDE_MAX)
+        percent = FEED_OVERRIDE_MAX;
+
+    //Picked up by the step task on its next step, nothing queued has to be planned again
+    feedOverride = percent;
+}
+
+void StepScheduler::setJunctionDeviation(float steps) {
+    SCHEDULER_LOCK();
+    planner.setJunctionDeviation(steps);
+    SCHEDULER_UNLOCK();
+}
+
+bool StepScheduler::queueLine(const int32_t delta[AXIS_COUNT], float feedRate, bool toolOn) {
+    Segment segment;
+    segment.toolOn = toolOn;
+    float lengthSqr = 0;
+    for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+        segment.delta[i] = delta[i];
+        lengthSqr += (float)delta[i] * delta[i];
+
+        uint32_t count = delta[i] < 0 ? -delta[i] : delta[i];
+        if (count > segment.events)
+            segment.events = count;
+    }
+
+    //Nothing to do counts as queued
+    if (segment.events == 0)
+        return true;
+
+    segment.length = sqrtf(lengthSqr);
+
+    //The profile runs on the major axis, scale every axis' limits onto it
+    for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+        uint32_t count = delta[i] < 0 ? -delta[i] : delta[i];
+        if (count == 0)
+            continue;
+
+        float scale = (float)segment.events / count;
+        if (segment.maxVelocity == 0 || maxVelocities[i] * scale < segment.maxVelocity)
+            segment.maxVelocity = maxVelocities[i] * scale;
+        if (segment.acceleration == 0 || accelerations[i] * scale < segment.acceleration)
+            segment.acceleration = accelerations[i] * scale;
+        if (segment.jerk == 0 || jerks[i] * scale < segment.jerk)
+            segment.jerk = jerks[i] * scale;
+    }
+
+    segment.limitVelocity = segment.maxVelocity;
+
+    float feedLimit = feedRate * segment.events / segment.length;
+    if (feedRate > 0 && feedLimit < segment.maxVelocity)
+        segment.maxVelocity = feedLimit;
+
+    //S-curves need every limit, otherwise fall back to the trapezoid
+    segment.mode = profileMode;
+    if (segment.acceleration <= 0 || segment.jerk <= 0)
+        segment.mode = PROFILE_TRAPEZOID;
+
+    SCHEDULER_LOCK();
+    bool queued = !queue.isFull();
+    if (queued) {
+        planner.prepare(segment, queue.isEmpty());
+        queue.push(segment);
+        planner.recalculate(queue);
+
+        for (uint8_t i = 0; i < AXIS_COUNT; i++)
+            plannedPositions[i] += delta[i];
+    }
+    SCHEDULER_UNLOCK();
+
+    return queued;
+}
+
+//Called from tick() with the lock held
+void StepScheduler::startSegment(const Segment &segment, float exitSpeedSqr) {
+    //Planner speeds are along the path, the profile runs on the major axis
+    float scale = segment.events / segment.length;
+    float entryVelocity = sqrtf(segment.entrySpeedSqr) * scale;
+    float exitVelocity = sqrtf(exitSpeedSqr) * scale;
+
+    //An override may have left the line before this one slower than it was planned to end
+    if (started && lastInterval > 0) {
+        float velocity = 1000000.0f / lastInterval * linePathScale * scale;
+        if (velocity < entryVelocity)
+            entryVelocity = velocity;
+    }
+
+    interpolator.begin(segment.delta);
+    lineMode = segment.mode;
+    lineToolOn = segment.toolOn;
+    lineAcceleration = segment.acceleration;
+    linePathScale = segment.length / segment.events;
+    if (lineMode == PROFILE_SCURVE) {
+        sCurve.begin(segment.events, entryVelocity, segment.maxVelocity, exitVelocity, segment.acceleration, segment.jerk);
+    } else {
+        trapezoid.setOverride(feedOverride);
+        trapezoid.begin(segment.events, entryVelocity, segment.maxVelocity, exitVelocity, segment.acceleration, segment.limitVelocity);
+    }
+}
+
+//Called from tick() with the lock held. S-curves are slowed down by stretching time, which scales
+//their acceleration by the square and jerk by the cube of the override, so neither can go over.
+uint32_t StepScheduler::stretchInterval(uint32_t interval) {
+    float target = (feedOverride < 100 ? feedOverride : 100) / 100.0f;
+
+    //The stretch only changes as fast as the line's acceleration allows, dv = v * dk <= a * dt
+    float planned = interval / 1000000.0f;
+    float change = lineAcceleration * planned * planned / timeScale;
+    if (target > timeScale)
+        timeScale = target - timeScale > change ? timeScale + change : target;
+    else if (target < timeScale)
+        timeScale = timeScale - target > change ? timeScale - change : target;
+
+    return (uint32_t)(interval / timeScale);
+}
+
+void StepScheduler::stop() {
+    const int32_t none[AXIS_COUNT] = {0};
+
+    SCHEDULER_LOCK();
+    queue.clear();
+    planner.reset();
+    interpolator.begin(none);
+    for (uint8_t i = 0; i < AXIS_COUNT; i++)
+        plannedPositions[i] = positions[i];
+    SCHEDULER_UNLOCK();
+}
+
+uint8_t StepScheduler::getQueueDepth() {
+    SCHEDULER_LOCK();
+    uint8_t depth = queue.getDepth();
+    SCHEDULER_UNLOCK();
+
+    return depth;
+}
+
+uint8_t StepScheduler::getQueueFree() {
+    SCHEDULER_LOCK();
+    uint8_t free = queue.getFree();
+    SCHEDULER_UNLOCK();
+
+    return free;
+}
+
+//Called with the lock held. Shaped axis keep moving for a while after the path stops.
+bool StepScheduler::isSettled(uint8_t axis) {
+    if (shapedPositions[axis] != positions[axis])
+        return false;
+
+    return axis >= SHAPED_AXES || shapers[axis].isSettled();
+}
+
+bool StepScheduler::isBusy() {
+    SCHEDULER_LOCK();
+    bool busy = !interpolator.isDone() || !queue.isEmpty();
+    for (uint8_t i = 0; i < AXIS_COUNT && !busy; i++)
+        busy = !isSettled(i);
+    SCHEDULER_UNLOCK();
+
+    return busy;
+}
+
+bool StepScheduler::isBusy(uint8_t axis) {
+    SCHEDULER_LOCK();
+    bool busy = (!interpolator.isDone() && interpolator.moves(axis)) || !isSettled(axis);
+    for (uint8_t i = 0; i < queue.getDepth() && !busy; i++)
+        busy = queue.at(i).delta[axis] != 0;
+    SCHEDULER_UNLOCK();
+
+    return busy;
+}
+
+bool StepScheduler::isToolOn() {
+    SCHEDULER_LOCK();
+    bool on = started && lineToolOn;
+    SCHEDULER_UNLOCK();
+
+    return on;
+}
+
+bool StepScheduler::isToolQueued() {
+    SCHEDULER_LOCK();
+    bool on = started && lineToolOn;
+    for (uint8_t i = 0; i < queue.getDepth() && !on; i++)
+        on = queue.at(i).toolOn;
+    SCHEDULER_UNLOCK();
+
+    return on;
+}
+
+uint32_t StepScheduler::getTimeToToolChange(uint32_t horizonUs) {
+    SCHEDULER_LOCK();
+    bool on = started && lineToolOn;
+    float time = started ? (float)interpolator.getRemaining() * lastInterval : 0;
+    float override = feedOverride / 100.0f;
+
+    bool changes = false;
+    uint8_t depth = queue.getDepth();
+    uint8_t i = 0;
+    for (; i < depth && time < horizonUs; i++) {
+        Segment &segment = queue.at(i);
+        if (segment.toolOn != on) {
+            changes = true;
+            break;
+        }
+
+        time += segment.events * 1000000.0f / (segment.maxVelocity * override);
+    }
+
+    //Going idle turns the tool off, so a tool that's on changes by the end of the queue at the latest
+    if (on && i == depth)
+        changes = true;
+    SCHEDULER_UNLOCK();
+
+    return changes && time < horizonUs ? (uint32_t)time : UINT32_MAX;
+}
+
+float StepScheduler::getVelocity(uint8_t axis) {
+    SCHEDULER_LOCK();
+    //Between two lines the last one's rate still holds, its final interval times the next step
+    bool moving = started && lastInterval > 0;
+    uint32_t interval = lastInterval;
+    uint32_t count = interpolator.getCount(axis);
+    uint32_t events = interpolator.getEvents();
+    SCHEDULER_UNLOCK();
+
+    if (!moving || events == 0)
+        return 0;
+
+    return 1000000.0f / interval * count / events;
+}
+
+int32_t StepScheduler::getPosition(uint8_t axis) {
+    SCHEDULER_LOCK();
+    int32_t position = positions[axis];
+    SCHEDULER_UNLOCK();
+
+    return position;
+}
+
+int32_t StepScheduler::getShapedPosition(uint8_t axis) {
+    SCHEDULER_LOCK();
+    int32_t position = shapedPositions[axis];
+    SCHEDULER_UNLOCK();
+
+    return position;
+}
+
+int32_t StepScheduler::getPlannedPosition(uint8_t axis) {
+    SCHEDULER_LOCK();
+    int32_t position = plannedPositions[axis];
+    SCHEDULER_UNLOCK();
+
+    return position;
+}
+
+void StepScheduler::setPosition(uint8_t axis, int32_t position) {
+    SCHEDULER_LOCK();
+    positions[axis] = position;
+    plannedPositions[axis] = position;
+    shapedPositions[axis] = position;
+    if (axis < SHAPED_AXES)
+        shapers[axis].reset(position);
+    SCHEDULER_UNLOCK();
+}
+
+void StepScheduler::tick(uint32_t nowUs) {
+    uint8_t stepMask = 0;
+    uint8_t forwardMask = 0;
+    uint8_t takeUpMask = 0;
+    uint8_t takeUpForward = 0;
+
+    //Work out what's due while locked, but do the (possibly I2C) stepping outside of it
+    SCHEDULER_LOCK();
+    //Segments run back to back, the first step of the next one lands where the last
+    //one's final interval says it should. Only an idle start is timed from now.
+    Segment segment;
+    if (interpolator.isDone()) {
+        if (queue.pop(segment)) {
+            planner.onPop();
+            startSegment(segment, queue.isEmpty() ? 0 : queue.at(0).entrySpeedSqr);
+        } else {
+            started = false;
+            timeScale = (feedOverride < 100 ? feedOverride : 100) / 100.0f;
+        }
+    }
+
+    if (!interpolator.isDone()) {
+        if (!started) {
+            nextStep = nowUs;
+            started = true;
+        }
+
+        if ((int32_t)(nowUs - nextStep) >= 0) {
+            //Schedule from the ideal time rather than now so tick jitter doesn't accumulate
+            if (lineMode == PROFILE_SCURVE) {
+                lastInterval = stretchInterval(sCurve.next());
+            } else {
+                trapezoid.setOverride(feedOverride);
+                lastInterval = trapezoid.next();
+            }
+            nextStep += lastInterval;
+            uint8_t pathMask = interpolator.next();
+            uint8_t pathForward = interpolator.getForwardMask();
+
+            for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+                if (pathMask & (1 << i))
+                    positions[i] += (pathForward & (1 << i)) ? 1 : -1;
+            }
+        }
+    }
+
+    //How often the path is stepping each axis, backlash is taken up at that rate. An axis the
+    //line doesn't move keeps the rate it last moved at.
+    uint32_t events = interpolator.getEvents();
+    for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+        uint32_t count = interpolator.getCount(i);
+        if (!started || lastInterval == 0 || count == 0)
+            continue;
+
+        uint32_t pace = (float)lastInterval * events / count;
+        paces[i] = pace > minIntervals[i] ? pace : minIntervals[i];
+    }
+
+    //Steps chase the shaped position, one per tick at most. Unshaped axis shape to where
+    //the path is, so they step right along with it.
+    for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+        uint8_t bit = 1 << i;
+        int32_t target = positions[i];
+        if (i < SHAPED_AXES && shapers[i].isEnabled())
+            target = shapers[i].shape(target);
+
+        //Backlash owed since a reversal goes first, at the path's own rate, so the motor never
+        //steps faster than the path has it going. The path's steps wait meanwhile, then catch up
+        //at up to twice that rate, never past the axis' limit. Neither the planned nor the shaped
+        //positions see the backlash.
+        if (takeUp[i] > 0) {
+            if (nowUs - lastSteps[i] >= paces[i])
+                takeUpMask |= bit;
+            continue;
+        }
+
+        if (target == shapedPositions[i]) {
+            catchingUp &= ~bit;
+            continue;
+        }
+
+        //Once caught up, the next path step still keeps the axis' limit from the last held one,
+        //less a tick so it's never late against its own timing.
+        uint32_t spacing = 0;
+        if (catchingUp & bit)
+            spacing = paces[i] / 2 > minIntervals[i] ? paces[i] / 2 : minIntervals[i];
+        else if ((offBeat & bit) && minIntervals[i] > STEP_TICK_US)
+            spacing = minIntervals[i] - STEP_TICK_US;
+        if (nowUs - lastSteps[i] < spacing)
+            continue;
+
+        stepMask |= bit;
+        if (target > shapedPositions[i])
+            forwardMask |= bit;
+    }
+    takeUpForward = directionMask;
+    SCHEDULER_UNLOCK();
+
+    //A motor that released its coils wakes them on the first step it's given rather than
+    //taking it. The step stays owed and goes out on a later tick, once the rotor's been held.
+    uint8_t takenMask = 0;
+    for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+        uint8_t bit = 1 << i;
+        bool forward;
+        if (stepMask & bit)
+            forward = forwardMask & bit;
+        else if (takeUpMask & bit)
+            forward = takeUpForward & bit;
+        else
+            continue;
+
+        if (onStep == nullptr || onStep(i, forward))
+            takenMask |= bit;
+    }
+
+    SCHEDULER_LOCK();
+    for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+        uint8_t bit = 1 << i;
+        if (!(takenMask & bit))
+            continue;
+
+        if (stepMask & bit) {
+            //A reversal owes the axis its backlash, less whatever of the last one it hadn't taken up yet
+            shapedPositions[i] += (forwardMask & bit) ? 1 : -1;
+            if ((forwardMask ^ directionMask) & bit)
+                takeUp[i] = backlash[i] - takeUp[i];
+            directionMask = (directionMask & ~bit) | (forwardMask & bit);
+            offBeat = (offBeat & ~bit) | (catchingUp & bit);
+        } else {
+            if (--takeUp[i] == 0)
+                catchingUp |= bit;
+            offBeat |= bit;
+        }
+        lastSteps[i] = nowUs;
+    }
+    SCHEDULER_UNLOCK();
+
+    if (onTick != nullptr)
+        onTick(nowUs);
+}
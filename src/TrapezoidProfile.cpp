@@ -0,0 +1,102 @@
+#include "TrapezoidProfile.h"
+
+void TrapezoidProfile::begin(uint32_t steps, float entryVelocity, float maxVelocity, float exitVelocity, float acceleration, float limitVelocity) {
+    total = steps;
+    step = 0;
+
+    this->acceleration = acceleration;
+    this->maxVelocity = maxVelocity;
+    this->limitVelocity = limitVelocity > maxVelocity ? limitVelocity : maxVelocity;
+    plan();
+
+    //No acceleration configured, run at a constant rate
+    if (acceleration <= 0) {
+        ramp.begin(0, maxVelocity);
+        exitN = 0;
+        accelSteps = decelSteps = 0;
+        return;
+    }
+
+    //Ramp indexes for each velocity, v^2 = 2 * a * n
+    float entryN = entryVelocity * entryVelocity / (2 * acceleration);
+    float maxN = maxVelocity * maxVelocity / (2 * acceleration);
+    float endN = exitVelocity * exitVelocity / (2 * acceleration);
+    if (entryN > maxN)
+        entryN = maxN;
+    if (endN > maxN)
+        endN = maxN;
+
+    //If the move is too short to reach full speed it becomes a triangle peaking where the ramps meet
+    float accel = maxN - entryN;
+    float decel = maxN - endN;
+    if (accel + decel > total) {
+        accel = (total + endN - entryN) / 2;
+        if (accel < 0)
+            accel = 0;
+        if (accel > total)
+            accel = total;
+        decel = total - accel;
+    }
+
+    exitN = (uint32_t)endN;
+    accelSteps = (uint32_t)accel;
+    decelSteps = (uint32_t)decel;
+
+    ramp.begin(acceleration, entryVelocity < maxVelocity ? entryVelocity : maxVelocity);
+}
+
+void TrapezoidProfile::setOverride(uint16_t percent) {
+    if (percent == override)
+        return;
+
+    override = percent;
+    plan();
+}
+
+//Cruise speed for the current override
+void TrapezoidProfile::plan() {
+    float velocity = maxVelocity * override / 100;
+    if (velocity > limitVelocity)
+        velocity = limitVelocity;
+
+    minInterval = (uint32_t)(1000000.0f / velocity);
+    cruiseN = acceleration > 0 ? (uint32_t)(velocity * velocity / (2 * acceleration)) : 0;
+}
+
+uint32_t TrapezoidProfile::next() {
+    step++;
+    if (acceleration <= 0)
+        return minInterval;
+
+    uint32_t interval = ramp.interval();
+    uint32_t cruise = interval > minInterval ? interval : minInterval;
+    uint32_t index = ramp.index();
+    uint32_t left = total - step;
+
+    //Stopping down to exitN takes index - exitN steps, start once that's all we have left
+    if (index > exitN && index - exitN >= left) {
+        ramp.decelerate();
+        return interval;
+    }
+
+    if (index < cruiseN) {
+        ramp.accelerate();
+        return cruise;
+    }
+
+    //The override came down, slow to it rather than dropping straight onto it
+    if (index > cruiseN) {
+        ramp.decelerate();
+        return interval;
+    }
+
+    return cruise;
+}
+
+float TrapezoidProfile::getVelocity() {
+    uint32_t interval = ramp.interval();
+    if (acceleration <= 0 || interval < minInterval)
+        interval = minInterval;
+
+    return 1000000.0f / interval;
+}
@@ -10,6 +10,15 @@
 #include <ArduinoHttpClient.h>
 #include <Adafruit_MCP23X17.h>
 #include <ESP32Servo.h>
+#include <Preferences.h>
+
+#include "StepScheduler.h"
+#include "ArcInterpolator.h"
+#include "GCodeInterpreter.h"
+#include "SpscQueue.h"
+#include "Homing.h"
+#include "SegmentMerger.h"
+#include "PenFollower.h"
 
 //In /c/Users/<user>/.platformio/packages/framework-arduinoespressif\variants\ttgo-t1\pins_arduino.h:24
 //Changed SCL pin from 23 to 22
@@ -30,11 +39,11 @@ int lastDisplayUpdateTime;
 
 const int Button1 = 35;
 
+//Printable volume in mm, measured by homing
 struct PrintBed{
-    int size = 260;
-    int width = size;
-    int depth = size;
-    int height = size;
+    float width = 0;
+    float depth = 0;
+    float height = 0;
 };
 PrintBed bed;
 
@@ -44,10 +53,20 @@ struct Motor{
     bool ready = false;
     bool useMcp = false; //Use our external mcp pins?
     bool reverseDirection = false;
-    float position;
-    float lastPosition;
+    int32_t position = 0; //In steps, like everything on the motion side
+    int32_t lastPosition = 0;
+    float stepsPerMm = 1; //Commands come in mm and are converted once, on the way in
+    float backlash = 0; //mm of slack the drive train loses when the axis reverses
+    ShaperType shaper = SHAPER_NONE; //Input shaping against frame ringing, X and Y only
+    float shaperFrequency = 0; //Hz the axis rings at
+    float shaperDamping = 0.1;
     int pins[4] = {0};
     int switches[2] = {-1, -1};
+    float maxVelocity = 0; //steps/s at full speed
+    float acceleration = 200; //steps/s^2
+    float jerk = 2000; //steps/s^3, only used by S-curve moves
+    StepperDriveMode driveMode = STEPPER_FULL_STEP; //Half stepping doubles steps, so stepsPerMm too
+    uint32_t holdTime = 0; //us the coils stay on after the last step before they're released, 0 holds them
     Stepper stepper = Stepper(STEPS, 0, 0, 0, 0, useMcp, mcp);
     void init(int steps = STEPS, int speed = 30) {
 
@@ -59,18 +78,31 @@ struct Motor{
 
         Serial.println("Initializing motor on pins " + String(pins[0]) + ", " +  String(pins[1]) + ", " + String(pins[2]) + " & " + String(pins[3]) + " | Uses MCP: " + String(useMcp));
 
+        //Half steps are what the stepper counts from here on
+        if (driveMode == STEPPER_HALF_STEP)
+            steps *= 2;
+
         if (reverseDirection)
             stepper = Stepper(steps, pins[2], pins[3], pins[0], pins[1], useMcp, mcp);
         else
             stepper = Stepper(steps, pins[0], pins[1], pins[2], pins[3], useMcp, mcp);
 
+        stepper.setDriveMode(driveMode);
+        stepper.setHoldTime(holdTime);
         stepper.setSpeed(speed);
+        maxVelocity = (float)steps * speed / 60;
+    }
+    int32_t toSteps(float mm) {
+        return lroundf(mm * stepsPerMm);
+    }
+    float toMm(int32_t steps) {
+        return steps / stepsPerMm;
     }
     bool scrolling = false;
-    float source;
-    float destination;
-    void scrollTo(float  coord) {
-        if (coord == position)
+    int32_t source = 0;
+    int32_t destination = 0;
+    void scrollTo(int32_t coord) {
+        if (coord == (scrolling ? destination : position))
             return;
 
         Serial.println("Scrolling to " + String(coord));
@@ -79,17 +111,6 @@ struct Motor{
         destination = coord;
         scrolling = true;
     }
-    //This must be <= 1
-    void changePosition(float amount) {
-        Serial.println("Changing by: " + String(amount));
-
-        //The stepper only takes ints so accomodate for that
-        if ((int)lastPosition != (int)position)
-            stepper.step(amount < 0 ? 1 : -1);
-
-        lastPosition = position;
-        position += amount;
-    }
     void endScroll() {
         Serial.println("Ending scroll at " + String(position));
 
@@ -98,32 +119,69 @@ struct Motor{
         lastPosition = position;
     }
 };
-Motor motors[3];
+Motor motors[AXIS_COUNT];
 
-bool isInitialized() {
-    bool initialized = true;
-    for (auto & motor : motors) {
-        if (!motor.ready) {
-            initialized = false;
-            break;
-        }
+//Steps a motor right away, homing steps through this. False if it only woke its released coils.
+bool stepAxis(uint8_t axis, bool forward) {
+    return motors[axis].stepper.stepNow(forward);
+}
+
+//Homing steps the motors from the motion task, the step task leaves their coils alone meanwhile
+volatile bool homingMotors = false;
+
+//Called by the step scheduler for every step it emits. The MCP holds its writes until the whole
+//tick's steps are in, see finishTick(), so X and Y stepping together change their shared port at once.
+//
+//A motor whose coils were released doesn't step here. It writes its remembered phase into this
+//tick's frame instead and the scheduler offers the step again next tick, so the held phase reaches
+//the chip a whole tick before the step's phase does rather than being merged into the same write.
+bool scheduleStep(uint8_t axis, bool forward) {
+    mcp.setWriteThrough(false);
+    return stepAxis(axis, forward);
+}
+
+//Called by the step scheduler every tick. Releasing from the step task means it's the only one
+//writing coils while the scheduler runs, so two motors sharing an MCP port can't trip over each other.
+//Releases join the frame too, so a motor letting go while another steps or wakes costs no extra write.
+void finishTick(uint32_t now) {
+    if (!homingMotors) {
+        mcp.setWriteThrough(false);
+        for (auto & motor : motors)
+            motor.stepper.releaseIfIdle(now);
     }
 
-    return initialized;
+    //Writes whatever the tick changed, both ports in one go if need be
+    mcp.setWriteThrough(true);
 }
 
+//The command task's view of whether every axis is homed, set when the motion task reports it
+bool initialized = false;
+
+//Collinear runs of lines are joined up before they take a queue slot
+SegmentMerger merger;
+
 //Pen vars
 #define PEN_FWD 12
 #define PEN_BCK 13
+
+//ms between updates of a synced pen's feed, one servo frame
+#define PEN_CONTROL_INTERVAL 20
+//Fastest the pen's servo goes
+#define PEN_MAX_SPEED 180
+
 struct PenObj {
     Servo speed;
     bool Hot = false;
     bool Retracting = false;
     bool Extruding = false;
+    bool Synced = false;    //Driven by the moves tagged by M3 rather than toggled by hand
+    bool Releasing = false; //M5 came in, hand the pen back once the lines before it are done
+    PenFollower follower;
+    int written = 90; //Last speed written to the servo
     void init(){
         Serial.println("Attaching servo pin");
         speed.attach(2);
-        speed.write(90); //halfway between 0 and 180
+        speed.write(written); //halfway between 0 and 180
     };
     void heat() {
         Serial.println("Heating pen...");
@@ -133,6 +191,9 @@ struct PenObj {
         Hot = true;
     }
     void toggleRetract() {
+        //Toggling is always by hand
+        Synced = false;
+
         if (Extruding) {
             Serial.println("Could not retract while extruding!");
             return;
@@ -150,6 +211,9 @@ struct PenObj {
         }
     }
     void toggleExtrude() {
+        //Toggling is always by hand
+        Synced = false;
+
         if (Retracting) {
             Serial.println("Could not extrude while retracting!");
             return;
@@ -166,8 +230,79 @@ struct PenObj {
             digitalWrite(PEN_FWD, LOW);
         }
     }
+    //Hand the pen over to the moves, follow() drives it from here on
+    void sync() {
+        Releasing = false;
+        if (Synced)
+            return;
+
+        Serial.println("Pen following the moves");
+        drive(false, false);
+        follower.reset();
+        Synced = true;
+    }
+    //Stop following once the extruding lines queued so far are done and the pen has pulled back
+    void release() {
+        if (Synced)
+            Releasing = true;
+    }
+    //Pen speed at PEN_NOMINAL_FEED while synced
+    void setFlow(float nominalSpeed) {
+        Serial.println("Setting flow to " + String(nominalSpeed) + " at " + String(PEN_NOMINAL_FEED) + "mm/s");
+        follower.flow = nominalSpeed / PEN_NOMINAL_FEED;
+    }
+    //Synced motor control, the pin going low is always switched first
+    void drive(bool forward, bool back) {
+        if (!forward && Extruding) {
+            Extruding = false;
+            digitalWrite(PEN_FWD, LOW);
+        }
+        if (!back && Retracting) {
+            Retracting = false;
+            digitalWrite(PEN_BCK, LOW);
+        }
+        if (forward && !Extruding) {
+            Extruding = true;
+            digitalWrite(PEN_FWD, HIGH);
+        }
+        if (back && !Retracting) {
+            Retracting = true;
+            digitalWrite(PEN_BCK, HIGH);
+        }
+    }
+    //Synced feeding, PEN_FWD is gated off while the head is close to stopped
+    void feed(float newSpeed, bool gate) {
+        int servo = newSpeed > 0 ? min((int)lroundf(newSpeed), PEN_MAX_SPEED) : 0;
+        if (servo != written) {
+            written = servo;
+            speed.write(servo);
+        }
+
+        drive(gate, false);
+    }
+    //Called every PEN_CONTROL_INTERVAL with the head's XY speed in mm/s, whether the line being
+    //stepped extrudes, how long in us until that changes and whether anything queued still extrudes
+    void follow(float velocity, bool toolOn, uint32_t untilChange, bool toolQueued) {
+        if (!Synced)
+            return;
+
+        PenAction action = follower.follow(millis(), velocity, toolOn, untilChange);
+        if (action == PEN_FEED)
+            feed(follower.getSpeed(), follower.isGated());
+        else
+            drive(false, action == PEN_RETRACT);
+
+        //After M5 the pen is left stopped, back under manual control
+        if (Releasing && !toolQueued && follower.isSettled()) {
+            Serial.println("Pen done following the moves");
+            drive(false, false);
+            Releasing = false;
+            Synced = false;
+        }
+    }
     void setSpeed(int newSpeed) {
         Serial.println("Setting speed to " + String(newSpeed));
+        written = newSpeed;
         speed.write(newSpeed);
     }
 };
@@ -187,7 +322,7 @@ void sendPost(String uri, String data) {
     httpClient.endRequest();
 }
 void sendStatus() {
-    sendPost("/api/printer/status", "{\"status\":" + String(isInitialized()) + "}");
+    sendPost("/api/printer/status", "{\"status\":" + String(initialized) + ",\"merged\":" + String(merger.getMerged()) + ",\"folded\":" + String(merger.getFolded()) + "}");
 }
 
 void drawScreen(String message = "", bool updateStatus = true);
@@ -236,92 +371,771 @@ void alert(String message, int timer) {
     drawScreen("", false);
 }
 
-//Use -1 to not move axis at all
-void scrollToCoords(float x, float y, float z, bool useRelative = false);
-void scrollToCoords(float x, float y, float z, bool useRelative) {
+/*
+ * Motion runs in its own task on MOTION_CORE, next to the step task. Commands, status
+ * reporting and the display run in a task on COMMAND_CORE. The two only talk through
+ * the SPSC queues below, so a slow HTTP post or screen redraw can never hold up a step.
+ * The feed override is the exception, a single word handed straight to the scheduler.
+ */
+#define COMMAND_CORE 0
+
+enum MotionCommandType {
+    MOTION_LINE,
+    MOTION_ARC,
+    MOTION_HOME,            //Waits for the moves before it to finish
+    MOTION_FAST_START,      //Falls back to a full home if the cache can't be trusted
+    MOTION_M_CODE,          //Waits for the moves before it to finish
+    MOTION_PEN_HEAT,
+    MOTION_PEN_EXTRUDE,     //Toggles extruding
+    MOTION_PEN_RETRACT,     //Toggles retracting
+    MOTION_PEN_SPEED,
+    MOTION_PROFILE,
+    MOTION_REPORT_SWITCHES
+};
+//Which axis a move gives a target for, the rest stay where they are
+#define AXIS_X 0x01
+#define AXIS_Y 0x02
+#define AXIS_Z 0x04
+#define ALL_AXES (AXIS_X | AXIS_Y | AXIS_Z)
+
+struct MotionCommand {
+    MotionCommandType type = MOTION_LINE;
+    uint32_t sequence = 0;
+    float target[AXIS_COUNT] = {0}; //In mm, only for the axis in axes
+    uint8_t axes = ALL_AXES;
+    bool relative = false;
+    float centreX = 0;              //Arc centre offset from the start, in mm
+    float centreY = 0;
+    bool clockwise = false;
+    float feedRate = 0;             //mm/s
+    uint16_t code = 0;              //M code or ProfileMode
+    bool hasS = false;
+    float s = 0;                    //M code S word or pen speed
+};
+
+enum MotionEventType {
+    MOTION_HOMING,
+    MOTION_HOMED,
+    MOTION_IDLE
+};
+struct MotionEvent {
+    MotionEventType type = MOTION_IDLE;
+    uint32_t sequence = 0;             //Last command the motion task finished
+    float positions[AXIS_COUNT] = {0}; //Where the queued moves will leave us, in mm
+    float sizes[AXIS_COUNT] = {0};     //Calibrated travel, in mm
+    bool ready = false;                //Every axis is homed
+};
+
+struct UdpMessage {
+    bool trusted = false;
+    char data[200] = {0};
+};
+
+SpscQueue<MotionCommand, 32> motionCommands; //Command task -> motion task
+SpscQueue<MotionEvent, 8> motionEvents;      //Motion task -> command task
+SpscQueue<UdpMessage, 4> udpMessages;        //AsyncUDP task -> command task
+
+//Motion task side
+
+//ms the motors have to sit idle before their position is cached
+#define CACHE_SAVE_DELAY 2000
+
+/*
+ * Axis lengths and the last position we came to rest at, kept in NVS so a boot
+ * can skip the full travel calibration. The position is only trusted if it was
+ * saved after the last move finished, clean is cleared before anything moves.
+ */
+struct CalibrationCache {
+    Preferences prefs;
+    bool calibrated = false;
+    bool clean = false;
+    int max[AXIS_COUNT] = {0};
+    int32_t positions[AXIS_COUNT] = {0};
+    void load() {
+        prefs.begin("printer", false);
+        calibrated = prefs.getBool("calibrated", false);
+        clean = calibrated && prefs.getBool("clean", false);
+        for (int i = 0; i < AXIS_COUNT; i++) {
+            max[i] = prefs.getInt(("max" + String(i)).c_str(), 0);
+            positions[i] = prefs.getInt(("pos" + String(i)).c_str(), 0);
+        }
+
+        Serial.println("Calibration cache: calibrated " + String(calibrated) + " | clean " + String(clean));
+    }
+    void saveCalibration(const int newMax[AXIS_COUNT]) {
+        for (int i = 0; i < AXIS_COUNT; i++) {
+            max[i] = newMax[i];
+            prefs.putInt(("max" + String(i)).c_str(), max[i]);
+        }
+
+        calibrated = true;
+        prefs.putBool("calibrated", true);
+    }
+    void savePosition(const int32_t newPositions[AXIS_COUNT]) {
+        for (int i = 0; i < AXIS_COUNT; i++) {
+            positions[i] = newPositions[i];
+            prefs.putInt(("pos" + String(i)).c_str(), positions[i]);
+        }
+
+        clean = true;
+        prefs.putBool("clean", true);
+    }
+    //Call before moving, a reset from here on leaves the cached position stale
+    void markMoving() {
+        if (!clean)
+            return;
+
+        clean = false;
+        prefs.putBool("clean", false);
+    }
+    //Something faulted, nothing cached can be trusted
+    void invalidate() {
+        Serial.println("Invalidating calibration cache");
+
+        calibrated = false;
+        clean = false;
+        prefs.putBool("calibrated", false);
+        prefs.putBool("clean", false);
+    }
+};
+CalibrationCache cache;
+
+ArcInterpolator arc;
+float arcFeedRate = 0;
+bool arcToolOn = false; //Chords keep the tool state the arc was started with, whatever M3/M5 came in since
+
+//Steps per mm along a move, turns a feed rate in mm/s into the steps/s the scheduler wants
+float pathStepsPerMm(const int32_t delta[AXIS_COUNT]) {
+    float steps = 0;
+    float mm = 0;
+    for (int i = 0; i < AXIS_COUNT; i++) {
+        float distance = motors[i].toMm(delta[i]);
+        steps += (float)delta[i] * delta[i];
+        mm += distance * distance;
+    }
+
+    return mm > 0 ? sqrtf(steps / mm) : 1;
+}
+
+//Whether lines queued from here on extrude. M3 and M5 set it in order with the moves, so the
+//pen can retract and prime ahead of them as they're stepped rather than waiting on the queue.
+bool penTool = false;
+
+//How fast the head is moving over the bed right now, in mm/s
+float xyVelocity() {
+    float x = Scheduler.getVelocity(0) / motors[0].stepsPerMm;
+    float y = Scheduler.getVelocity(1) / motors[1].stepsPerMm;
+    return sqrtf(x * x + y * y);
+}
+
+//Queue as many of the current arc's chords as there's room for
+void queueArcChords() {
+    int32_t target[AXIS_COUNT];
+    while (Scheduler.getQueueFree() > 0 && arc.next(target)) {
+        int32_t delta[AXIS_COUNT];
+        for (int i = 0; i < AXIS_COUNT; i++)
+            delta[i] = target[i] - Scheduler.getPlannedPosition(i);
+
+        Scheduler.queueLine(delta, arcFeedRate * pathStepsPerMm(delta), arcToolOn);
+    }
+}
+
+//Anything queued after an arc has to wait for the rest of its chords
+void finishArc() {
+    while (arc.isActive()) {
+        queueArcChords();
+        delay(1);
+    }
+}
+
+//Where an axis ends up once everything queued, and the line held for merging, is done
+int32_t plannedPosition(int axis) {
+    return merger.isHolding() ? merger.getEnd(axis) : Scheduler.getPlannedPosition(axis);
+}
+
+//Queue the line held for merging, waiting on the scheduler to make room if it has to
+void flushLines() {
+    int32_t target[AXIS_COUNT];
+    float feedRate;
+    if (!merger.take(target, feedRate))
+        return;
+
+    int32_t delta[AXIS_COUNT];
+    for (int i = 0; i < AXIS_COUNT; i++)
+        delta[i] = target[i] - Scheduler.getPlannedPosition(i);
+
+    float stepRate = feedRate * pathStepsPerMm(delta);
+    while (!Scheduler.queueLine(delta, stepRate, penTool))
+        delay(1);
+}
+
+//Coordinates are in mm, axis missing from axes don't move at all. feedRate caps the speed along the path in mm/s, 0 is full speed.
+void scrollToCoords(float x, float y, float z, uint8_t axes = ALL_AXES, bool useRelative = false, float feedRate = 0);
+void scrollToCoords(float x, float y, float z, uint8_t axes, bool useRelative, float feedRate) {
     Serial.println("Sending to coords: " + String(x) + " | " + String(y) + " | " + String(z));
 
+    cache.markMoving();
+    finishArc();
+
+    //Relative to where the queued moves will leave us, not where we are now
     if (useRelative) {
-        x = motors[0].position + x;
-        y = motors[1].position + y;
-        z = motors[2].position + z;
+        x = motors[0].toMm(plannedPosition(0)) + x;
+        y = motors[1].toMm(plannedPosition(1)) + y;
+        z = motors[2].toMm(plannedPosition(2)) + z;
     }
 
-    if (x > -1)
-        motors[0].scrollTo(x);
+    if (axes & AXIS_X)
+        motors[0].scrollTo(motors[0].toSteps(x));
+
+    if (axes & AXIS_Y)
+        motors[1].scrollTo(motors[1].toSteps(y));
+
+    if (axes & AXIS_Z)
+        motors[2].scrollTo(motors[2].toSteps(z));
+
+    int32_t from[AXIS_COUNT];
+    int32_t target[AXIS_COUNT];
+    for (int i = 0; i < AXIS_COUNT; i++) {
+        from[i] = plannedPosition(i);
+        target[i] = motors[i].scrolling ? motors[i].destination : from[i];
+    }
+
+    //Held back in case the next line carries on in the same direction, queued once it doesn't
+    if (!merger.add(from, target, feedRate)) {
+        flushLines();
+        merger.add(from, target, feedRate);
+    }
+}
+
+//Arc in the XY plane to x/y around a centre offset by i/j from where the queued moves leave us, all in mm.
+//z moves along with it for a helix if AXIS_Z is in axes. Chords are queued from loop() as room frees up.
+//The arc is run in steps, so it's only round if X and Y have the same steps per mm.
+void arcToCoords(float x, float y, float z, uint8_t axes, float i, float j, bool clockwise, float feedRate = 0);
+void arcToCoords(float x, float y, float z, uint8_t axes, float i, float j, bool clockwise, float feedRate) {
+    Serial.println("Arcing to coords: " + String(x) + " | " + String(y) + " | " + String(z) + " around " + String(i) + " | " + String(j));
+
+    cache.markMoving();
+    flushLines();
+    finishArc();
+
+    float start[AXIS_COUNT];
+    for (int axis = 0; axis < AXIS_COUNT; axis++)
+        start[axis] = Scheduler.getPlannedPosition(axis);
+
+    float end[AXIS_COUNT] = {
+        (float)motors[0].toSteps(x),
+        (float)motors[1].toSteps(y),
+        axes & AXIS_Z ? (float)motors[2].toSteps(z) : start[2]
+    };
+    for (int axis = 0; axis < AXIS_COUNT; axis++)
+        motors[axis].scrollTo((int32_t)end[axis]);
+
+    arcFeedRate = feedRate;
+    arcToolOn = penTool;
+    arc.begin(start, end, i * motors[0].stepsPerMm, j * motors[1].stepsPerMm, clockwise);
+    queueArcChords();
+}
+
+Homing homing;
+
+//Every axis is at a known position, hand them back to the scheduler and centre up.
+//onMax says which switches were touched last, so the slack is taken up in that direction.
+void homed(bool onMax) {
+    for (int i = 0; i < AXIS_COUNT; i++) {
+        Scheduler.setPosition(i, motors[i].position);
+        Scheduler.setDirection(i, onMax);
+    }
+
+//    while (motors[0].position > (motors[0].max / 2)) {
+//        motors[0].stepper.step(1);
+//    }
+
+    motors[0].ready = true;
+    motors[1].ready = true;
+    motors[2].ready = true;
+
+    Serial.println("Initialized axis with the following sizes;");
+    Serial.println("X: " + String(motors[0].max) + " | Y: " + String(motors[1].max) + " | Z: " + String(motors[2].max));
 
-    if (y > -1)
-        motors[1].scrollTo(y);
+    scrollToCoords(motors[0].toMm(motors[0].max) / 2, motors[1].toMm(motors[1].max) / 2, 0);
 
-    if (z > -1)
-        motors[2].scrollTo(z);
+    Serial.println("Initialization complete!");
 }
 
 void initialize() {
-    alert("Initializing...");
+    //Homing steps the motors directly so make sure the scheduler isn't also driving them
+    arc.cancel();
+    merger.cancel();
+    Scheduler.stop();
+    cache.markMoving();
+
+    Serial.println("Initializing...");
     delay(500);
 
     Serial.println("Switch set 8:" + String(mcp.digitalRead(8)) + " | 9: " + String(mcp.digitalRead(9)));
     Serial.println("Switch set 10: " + String(mcp.digitalRead(10)) + " | 11: " + String(mcp.digitalRead(11)));
     Serial.println("Switch set 12: " + String(mcp.digitalRead(12)) + " | 13: " + String(mcp.digitalRead(13)));
 
+    for (auto & motor : motors)
+        motor.ready = false;
+
     // Zero out all axis
-    while (mcp.digitalRead(8) == HIGH || mcp.digitalRead(10) == HIGH || mcp.digitalRead(12) == HIGH) {
-        if (mcp.digitalRead(8) == HIGH)
-            motors[0].stepper.step(-1);
+    homingMotors = true;
+    bool homedMin = homing.run(false);
+    homingMotors = false;
+    if (!homedMin) {
+        Serial.println("Homing failed, an axis never reached its min switch.");
+        cache.invalidate();
+        return;
+    }
+
+    for (auto & motor : motors)
+        motor.position = 0;
 
-        if (mcp.digitalRead(10) == HIGH)
-            motors[1].stepper.step(-1);
+    Serial.println("Zero'd out all axis' in " + String(homing.getDuration()) + "ms.");
+    Serial.println("Min switch repeatability X: " + String(homing.getSpread(0)) + " | Y: " + String(homing.getSpread(1)) + " | Z: " + String(homing.getSpread(2)) + " steps");
 
-        if (mcp.digitalRead(12) == HIGH)
-            motors[2].stepper.step(-1);
+    // Max out all axis
+    homingMotors = true;
+    bool homedMax = homing.run(true);
+    homingMotors = false;
+    if (!homedMax) {
+        Serial.println("Homing failed, an axis never reached its max switch.");
+        cache.invalidate();
+        return;
     }
 
-    motors[0].position = 0;
-    motors[1].position = 0;
-    motors[2].position = 0;
+    for (int i = 0; i < AXIS_COUNT; i++) {
+        motors[i].position = homing.getPosition(i);
+        motors[i].max = motors[i].position;
+    }
 
-    Serial.println("Zero'd out all axis'.");
+    Serial.println("Found max travel in " + String(homing.getDuration()) + "ms.");
+    Serial.println("Max switch repeatability X: " + String(homing.getSpread(0)) + " | Y: " + String(homing.getSpread(1)) + " | Z: " + String(homing.getSpread(2)) + " steps");
 
-    // Max out all axis
-    while (mcp.digitalRead(9) == HIGH || mcp.digitalRead(11) == HIGH || mcp.digitalRead(13) == HIGH) {
-        if (mcp.digitalRead(9) == HIGH) {
-            motors[0].stepper.step(1);
-            motors[0].position++;
+    int max[AXIS_COUNT];
+    for (int i = 0; i < AXIS_COUNT; i++)
+        max[i] = motors[i].max;
+    cache.saveCalibration(max);
+
+    homed(true);
+}
+
+//Trust the cached axis lengths and position, only touching the min switches to check them.
+//Returns false if there's nothing to trust or the touch disagrees, initialize() has to run instead.
+bool fastStart() {
+    if (!cache.calibrated || !cache.clean)
+        return false;
+
+    Serial.println("Fast starting from cached calibration...");
+    uint32_t started = millis();
+
+    arc.cancel();
+    merger.cancel();
+    Scheduler.stop();
+    for (auto & motor : motors)
+        motor.ready = false;
+
+    //Run up close to the switches at full speed
+    int32_t approach[AXIS_COUNT];
+    int32_t delta[AXIS_COUNT];
+    for (int i = 0; i < AXIS_COUNT; i++) {
+        Scheduler.setPosition(i, cache.positions[i]);
+        approach[i] = min(cache.positions[i], (int32_t)HOMING_VERIFY_MARGIN);
+        delta[i] = approach[i] - cache.positions[i];
+    }
+
+    cache.markMoving();
+    Scheduler.queueLine(delta);
+    while (Scheduler.isBusy())
+        delay(1);
+
+    //Then touch them, they should be right where the cache says
+    homingMotors = true;
+    bool verified = homing.run(false, 2 * HOMING_VERIFY_MARGIN);
+    homingMotors = false;
+    for (int i = 0; i < AXIS_COUNT && verified; i++)
+        verified = abs(homing.getPosition(i) + approach[i]) <= HOMING_VERIFY_TOLERANCE;
+
+    if (!verified) {
+        Serial.println("Fast start touch didn't match the cached position.");
+        cache.invalidate();
+        return false;
+    }
+
+    for (int i = 0; i < AXIS_COUNT; i++) {
+        motors[i].position = 0;
+        motors[i].max = cache.max[i];
+    }
+
+    Serial.println("Verified cached calibration in " + String(millis() - started) + "ms.");
+
+    homed(false);
+    return true;
+}
+
+bool isInitialized() {
+    bool initialized = true;
+    for (auto & motor : motors) {
+        if (!motor.ready) {
+            initialized = false;
+            break;
         }
+    }
+
+    return initialized;
+}
 
-        if (mcp.digitalRead(11) == HIGH) {
-            motors[1].stepper.step(1);
-            motors[1].position++;
+uint32_t lastDoneCommand = 0;     //Sequence of the last command we finished
+uint32_t lastReportedCommand = 0; //Sequence of the last command we reported being idle after
+
+void reportMotion(MotionEventType type, uint32_t sequence) {
+    MotionEvent event;
+    event.type = type;
+    event.sequence = sequence;
+    event.ready = isInitialized();
+    for (int i = 0; i < AXIS_COUNT; i++) {
+        event.positions[i] = motors[i].toMm(Scheduler.getPlannedPosition(i));
+        event.sizes[i] = motors[i].toMm(motors[i].max);
+    }
+
+    //Never wait on the command task, it'll resync from the next event
+    if (!motionEvents.push(event))
+        Serial.println("Motion event queue full, dropping event");
+}
+
+//Returns false if the command has to wait for the moves before it, it's retried next time round
+bool runMotionCommand(const MotionCommand &command) {
+    //Only lines can be merged, anything else has to come after the one being held
+    if (command.type != MOTION_LINE)
+        flushLines();
+
+    bool idle = !Scheduler.isBusy() && !arc.isActive();
+
+    switch (command.type) {
+        case MOTION_LINE:
+            scrollToCoords(command.target[0], command.target[1], command.target[2], command.axes, command.relative, command.feedRate);
+            break;
+        case MOTION_ARC:
+            arcToCoords(command.target[0], command.target[1], command.target[2], command.axes, command.centreX, command.centreY, command.clockwise, command.feedRate);
+            break;
+        case MOTION_HOME:
+            //Homing drops whatever is queued, so let it finish first
+            if (!idle)
+                return false;
+
+            reportMotion(MOTION_HOMING, command.sequence);
+            initialize();
+            reportMotion(MOTION_HOMED, command.sequence);
+            break;
+        case MOTION_FAST_START:
+            if (!idle)
+                return false;
+
+            reportMotion(MOTION_HOMING, command.sequence);
+            if (!fastStart())
+                initialize();
+            reportMotion(MOTION_HOMED, command.sequence);
+            break;
+        case MOTION_M_CODE:
+            //Extruding or not rides along with the moves, the pen follows them as they're stepped
+            if (command.code == 3) {
+                //Extrude along with the moves that follow, S sets the pen speed at PEN_NOMINAL_FEED
+                if (command.hasS)
+                    Pen.setFlow(command.s);
+                Pen.sync();
+                penTool = true;
+                break;
+            } else if (command.code == 5) {
+                penTool = false;
+                if (Pen.Synced) {
+                    Pen.release();
+                    break;
+                }
+            }
+
+            //Other pen changes wait for the moves before them to finish
+            if (!idle)
+                return false;
+
+            switch (command.code) {
+                case 4: //Retract
+                    penTool = false;
+                    if (Pen.Extruding)
+                        Pen.toggleExtrude();
+                    if (!Pen.Retracting)
+                        Pen.toggleRetract();
+                    break;
+                case 5: //Stop a pen run by hand
+                    if (Pen.Extruding)
+                        Pen.toggleExtrude();
+                    if (Pen.Retracting)
+                        Pen.toggleRetract();
+                    break;
+                case 104: //Heat the pen
+                    if (!Pen.Hot)
+                        Pen.heat();
+                    break;
+                case 400: //Wait for moves to finish, which they have by now
+                    break;
+                default:
+                    Serial.println("Ignoring unknown M" + String(command.code));
+                    break;
+            }
+            break;
+        case MOTION_PEN_HEAT:
+            if (!Pen.Hot)
+                Pen.heat();
+            break;
+        case MOTION_PEN_EXTRUDE:
+            Pen.toggleExtrude();
+            break;
+        case MOTION_PEN_RETRACT:
+            Pen.toggleRetract();
+            break;
+        case MOTION_PEN_SPEED:
+            Pen.setSpeed(command.s);
+            break;
+        case MOTION_PROFILE:
+            Scheduler.setProfileMode((ProfileMode)command.code);
+            break;
+        case MOTION_REPORT_SWITCHES:
+            Serial.println("Switch set 8:" + String(mcp.digitalRead(8)) + " | 9: " + String(mcp.digitalRead(9)));
+            Serial.println("Switch set 10: " + String(mcp.digitalRead(10)) + " | 11: " + String(mcp.digitalRead(11)));
+            Serial.println("Switch set 12: " + String(mcp.digitalRead(12)) + " | 13: " + String(mcp.digitalRead(13)));
+            break;
+    }
+
+    return true;
+}
+
+void motionTaskLoop(void *arg) {
+    //Start stepping from here so the step timer's interrupt lands on this core too
+    Scheduler.attach(scheduleStep);
+    Scheduler.attachTick(finishTick);
+    Scheduler.begin();
+
+    //Pick up where we left off if the last shutdown was clean
+    if (cache.clean) {
+        reportMotion(MOTION_HOMING, 0);
+        if (!fastStart())
+            initialize();
+        reportMotion(MOTION_HOMED, 0);
+    }
+
+    uint32_t idleSince = millis();
+    uint32_t lastPenUpdate = 0;
+    for (;;) {
+        //Steps are emitted by the scheduler, we only keep our positions in sync with it here
+        for (int i = 0; i < AXIS_COUNT; i++) {
+            Motor &motor = motors[i];
+            motor.position = Scheduler.getPosition(i);
+
+            if (motor.scrolling && !arc.isActive() && !Scheduler.isBusy(i))
+                motor.endScroll();
+        }
+
+        queueArcChords();
+
+        MotionCommand *command = motionCommands.peek();
+        if (command != nullptr && runMotionCommand(*command)) {
+            lastDoneCommand = command->sequence;
+            motionCommands.drop();
+        }
+
+        //Nothing more to merge the held line with yet, don't keep it waiting
+        if (motionCommands.isEmpty())
+            flushLines();
+
+        //A synced pen feeds in proportion to how fast the head is going, and gets ready for what's queued
+        if (millis() - lastPenUpdate >= PEN_CONTROL_INTERVAL) {
+            lastPenUpdate = millis();
+            bool toolQueued = Scheduler.isToolQueued() || (arc.isActive() && arcToolOn);
+            Pen.follow(xyVelocity(), Scheduler.isToolOn(), Scheduler.getTimeToToolChange(Pen.follower.getHorizon()), toolQueued);
         }
 
-        if (mcp.digitalRead(13) == HIGH) {
-            motors[2].stepper.step(1);
-            motors[2].position++;
+        bool idle = motionCommands.isEmpty() && !Scheduler.isBusy() && !arc.isActive();
+        if (!idle)
+            idleSince = millis();
+
+        //Let the command side know where we ended up once everything it sent is done
+        if (idle && lastDoneCommand != lastReportedCommand) {
+            reportMotion(MOTION_IDLE, lastDoneCommand);
+            lastReportedCommand = lastDoneCommand;
         }
+
+        //Settled for a while, remember where so the next boot can fast start
+        if (idle && !cache.clean && isInitialized() && millis() - idleSince >= CACHE_SAVE_DELAY) {
+            int32_t positions[AXIS_COUNT];
+            for (int i = 0; i < AXIS_COUNT; i++)
+                positions[i] = Scheduler.getPosition(i);
+            cache.savePosition(positions);
+        }
+
+        vTaskDelay(1);
     }
+}
 
-    motors[0].max = motors[0].position;
-    motors[1].max = motors[1].position;
-    motors[2].max = motors[2].position;
+//Command task side
 
-//    while (motors[0].position > (motors[0].max / 2)) {
-//        motors[0].stepper.step(1);
-//    }
+uint32_t lastCommand = 0; //Sequence of the last command sent to the motion task
 
-    motors[0].ready = true;
-    motors[1].ready = true;
-    motors[2].ready = true;
+//Returns false if the motion task has fallen behind and the queue is full
+bool sendMotion(MotionCommand command) {
+    command.sequence = lastCommand + 1;
+    if (!motionCommands.push(command))
+        return false;
 
-    Serial.println("Initialized axis with the following sizes;");
-    Serial.println("X: " + String(motors[0].max) + " | Y: " + String(motors[1].max) + " | Z: " + String(motors[2].max));
+    lastCommand = command.sequence;
+    return true;
+}
 
-    scrollToCoords(motors[0].max / 2, motors[1].max / 2, 0);
+//For commands with nowhere to hold off, like IR and UDP
+void sendMotionWait(const MotionCommand &command) {
+    while (!sendMotion(command))
+        delay(1);
+}
 
-    Serial.println("Initialization complete!");
+void sendMotion(MotionCommandType type) {
+    MotionCommand command;
+    command.type = type;
+    sendMotionWait(command);
+}
+
+void sendPenSpeed(int speed) {
+    MotionCommand command;
+    command.type = MOTION_PEN_SPEED;
+    command.s = speed;
+    sendMotionWait(command);
+}
+
+void sendProfile(ProfileMode mode) {
+    MotionCommand command;
+    command.type = MOTION_PROFILE;
+    command.code = mode;
+    sendMotionWait(command);
+}
+
+//Axis missing from axes don't move at all
+void sendLine(float x, float y, float z, uint8_t axes = ALL_AXES, bool relative = false);
+void sendLine(float x, float y, float z, uint8_t axes, bool relative) {
+    MotionCommand command;
+    command.type = MOTION_LINE;
+    command.target[0] = x;
+    command.target[1] = y;
+    command.target[2] = z;
+    command.axes = axes;
+    command.relative = relative;
+    sendMotionWait(command);
+}
+
+//Runs G-code streamed over serial, coordinates are in mm
+struct PrinterGCode : GCodeMachine {
+    //Where the commands we've sent will leave us. The motion task lags behind so we keep our own.
+    float positions[AXIS_COUNT] = {0};
+    bool homing = false; //Positions are unknown until the motion task reports homing done
+
+    //Only take a move once there's room for it so the interpreter holds off rather than us blocking
+    bool send(const MotionCommand &command) {
+        return !homing && sendMotion(command);
+    }
+    float getPosition(uint8_t axis) override {
+        return positions[axis];
+    }
+    bool line(const float target[AXIS_COUNT], float feedRate) override {
+        MotionCommand command;
+        command.type = MOTION_LINE;
+        for (int i = 0; i < AXIS_COUNT; i++)
+            command.target[i] = target[i];
+        command.feedRate = feedRate;
+        if (!send(command))
+            return false;
+
+        for (int i = 0; i < AXIS_COUNT; i++)
+            positions[i] = target[i];
+        return true;
+    }
+    bool arc(const float target[AXIS_COUNT], float centreX, float centreY, bool clockwise, float feedRate) override {
+        MotionCommand command;
+        command.type = MOTION_ARC;
+        for (int i = 0; i < AXIS_COUNT; i++)
+            command.target[i] = target[i];
+        command.centreX = centreX;
+        command.centreY = centreY;
+        command.clockwise = clockwise;
+        command.feedRate = feedRate;
+        if (!send(command))
+            return false;
+
+        for (int i = 0; i < AXIS_COUNT; i++)
+            positions[i] = target[i];
+        return true;
+    }
+    bool home() override {
+        MotionCommand command;
+        command.type = MOTION_HOME;
+        if (!send(command))
+            return false;
+
+        homing = true;
+        return true;
+    }
+    bool mCode(uint16_t code, bool hasS, float s) override {
+        //The motion task holds these back until the moves before them are done
+        MotionCommand command;
+        command.type = MOTION_M_CODE;
+        command.code = code;
+        command.hasS = hasS;
+        command.s = s;
+        return send(command);
+    }
+    //Once the motion task has caught up with everything we sent its positions are ours
+    void sync(const MotionEvent &event) {
+        if (event.sequence != lastCommand)
+            return;
+
+        if (event.type == MOTION_HOMED)
+            homing = false;
+
+        for (int i = 0; i < AXIS_COUNT; i++)
+            positions[i] = event.positions[i];
+    }
+};
+PrinterGCode printerGCode;
+GCodeInterpreter gcode(printerGCode);
+
+void reportGCode(GCodeStatus status) {
+    switch (status) {
+        case GCODE_OK:
+            Serial.println("ok");
+            break;
+        case GCODE_ERROR_CHECKSUM:
+        case GCODE_ERROR_LINE_NUMBER:
+            Serial.println("rs " + String(gcode.getLineNumber() + 1));
+            break;
+        case GCODE_ERROR_OVERFLOW:
+            Serial.println("error: line too long");
+            break;
+        case GCODE_ERROR_SYNTAX:
+            Serial.println("error: bad syntax");
+            break;
+        case GCODE_ERROR_UNSUPPORTED:
+            Serial.println("error: unsupported command");
+            break;
+        default:
+            break;
+    }
+}
 
-    //Draw the screen again after we re-init
-    drawScreen();
+//Stream G-code from serial, we stop reading while the interpreter waits on the motion queue
+void readGCode() {
+    GCodeStatus status = gcode.poll();
+    reportGCode(status);
+
+    while (status != GCODE_PENDING && Serial.available()) {
+        status = gcode.feed((char)Serial.read());
+        reportGCode(status);
+    }
 }
 
 struct IRButtons{
@@ -348,85 +1162,113 @@ struct IRButtons{
     char nine[9] = "b54aff00";
 };
 IRButtons buttons;
+
+//Percent each press of the feed override buttons changes it by
+#define FEED_OVERRIDE_STEP 10
+
+//Goes straight to the scheduler rather than queueing behind the moves it's meant to speed up,
+//the one thing that crosses to MOTION_CORE outside the queues
+void setFeedOverride(int32_t percent) {
+    Scheduler.setFeedOverride(percent);
+    alert("Feed rate " + String(Scheduler.getFeedOverride()) + "%");
+}
 void performIRFunction(char event[9]) {
     alert("IR: " + String(event));
     Serial.println("Caught IR function " + String(event));
 
     //Power Button = Full Initialize
     if (strcmp(event, buttons.power) == 0)
-        initialize();
+        sendMotion(MOTION_HOME);
     else
-        //Zero Button = Set initialized without moving motors
+        //Zero Button = Fast start from the cached calibration
     if (strcmp(event, buttons.zero) == 0)
-        initialize();
+        sendMotion(MOTION_FAST_START);
     else
         //Skip Back = Zero all motors
     if (strcmp(event, buttons.back) == 0)
-        scrollToCoords(0, 0, -1);
+        sendLine(0, 0, 0, AXIS_X | AXIS_Y);
     else
         //Skip Forward = Max all motors
     if (strcmp(event, buttons.frwrd) == 0)
-        scrollToCoords(bed.size, bed.size, -1);
+        sendLine(bed.width, bed.depth, 0, AXIS_X | AXIS_Y);
     else
         //Play Button = Center all motors
     if (strcmp(event, buttons.play) == 0) {
-        float half = (float)bed.size / 2;
-        scrollToCoords(half, half, -1);
+        sendLine(bed.width / 2, bed.depth / 2, 0, AXIS_X | AXIS_Y);
     } else
         //Volume Down = toggle lower pen
     if (strcmp(event, buttons.volDwn) == 0) {
         Serial.println("Sending down!");
-        scrollToCoords(-1, -1, -50, true);
+        sendLine(0, 0, -50, AXIS_Z, true);
     } else
         //Volume Up = toggle raise pen
     if (strcmp(event, buttons.volUp) == 0) {
         Serial.println("Sending up!");
-        scrollToCoords(-1, -1, 50, true);
+        sendLine(0, 0, 50, AXIS_Z, true);
     } else
         //Func Button = Turn on pen
-    if (strcmp(event, buttons.func) == 0) {
-        if (!Pen.Hot)
-            Pen.heat();
-    } else
+    if (strcmp(event, buttons.func) == 0)
+        sendMotion(MOTION_PEN_HEAT);
+    else
 
         //Up Button = Retract
     if (strcmp(event, buttons.up) == 0)
-        Pen.toggleRetract();
+        sendMotion(MOTION_PEN_RETRACT);
     else
 
         //Down Button = Extrude
     if (strcmp(event, buttons.down) == 0)
-        Pen.toggleExtrude();
+        sendMotion(MOTION_PEN_EXTRUDE);
     else
 
     if (strcmp(event, buttons.one) == 0)
-        Pen.setSpeed(0);
+        sendPenSpeed(0);
     else
 
     if (strcmp(event, buttons.two) == 0)
-        Pen.setSpeed(180);
+        sendPenSpeed(180);
+    else
+
+        //4, 5 & 6 = Slower, planned and faster feed rate
+    if (strcmp(event, buttons.four) == 0)
+        setFeedOverride(Scheduler.getFeedOverride() - FEED_OVERRIDE_STEP);
+    else
+    if (strcmp(event, buttons.five) == 0)
+        setFeedOverride(100);
+    else
+    if (strcmp(event, buttons.six) == 0)
+        setFeedOverride(Scheduler.getFeedOverride() + FEED_OVERRIDE_STEP);
 
     alert("Func Complete");
 }
 
-void processUdp(AsyncUDPPacket packet) {
+//Runs in the AsyncUDP task, only copies the packet over to the command task
+void receiveUdp(AsyncUDPPacket packet) {
+    UdpMessage message;
+
     //Validate the incoming IP address
-    String source = "UNKNOWN";
-    if (packet.remoteIP().toString().indexOf("128.199.7.114") != 0) {
+    message.trusted = packet.remoteIP().toString().indexOf("128.199.7.114") == 0;
+
+    size_t length = packet.length();
+    if (length > sizeof(message.data) - 1)
+        length = sizeof(message.data) - 1;
+    memcpy(message.data, packet.data(), length);
+    message.data[length] = '\0'; // ensure null termination
+
+    Serial.println("Received " + String(message.data) + " from UDP@" + packet.remoteIP().toString());
+
+    if (!udpMessages.push(message))
+        Serial.println("UDP queue full, dropping packet");
+}
+
+void processUdp(const UdpMessage &message) {
+    if (!message.trusted) {
         alert("Received UDP request from unknown source");
         return;
     }
 
-    char* tmpStr = (char*) malloc(packet.length() + 1);
-    memcpy(tmpStr, packet.data(), packet.length());
-    tmpStr[packet.length()] = '\0'; // ensure null termination
-    String dataString = String(tmpStr);
-    free(tmpStr);
-
-    Serial.println("Received " + dataString + " from UDP@" + packet.remoteIP().toString());
-
     StaticJsonDocument<200> json;
-    DeserializationError error = deserializeJson(json, dataString);
+    DeserializationError error = deserializeJson(json, message.data);
     if (error) {
         Serial.println("JSON ERROR!");
         Serial.print(F("deserializeJson() failed: "));
@@ -437,17 +1279,81 @@ void processUdp(AsyncUDPPacket packet) {
 
     if (json.containsKey("CMD")) {
         if (json["CMD"] == "PEN_ON") {
-            if (!Pen.Hot)
-                Pen.heat();
+            sendMotion(MOTION_PEN_HEAT);
         } else if (json["CMD"] == "PEN_FWD") {
-            Pen.toggleExtrude();
+            sendMotion(MOTION_PEN_EXTRUDE);
         } else if (json["CMD"] == "PEN_BCK") {
-            Pen.toggleRetract();
+            sendMotion(MOTION_PEN_RETRACT);
+        } else if (json["CMD"] == "SCURVE_ON") {
+            sendProfile(PROFILE_SCURVE);
+        } else if (json["CMD"] == "SCURVE_OFF") {
+            sendProfile(PROFILE_TRAPEZOID);
+        } else if (json["CMD"] == "FEED" && json.containsKey("PERCENT")) {
+            setFeedOverride(json["PERCENT"].as<int>());
         } else
             alert("Requested action not recognized.");
     } else
         alert("Spirit requested no action.");
 }
+//Catch up with what the motion task has done
+void readMotionEvents() {
+    MotionEvent event;
+    while (motionEvents.pop(event)) {
+        if (event.type == MOTION_HOMING) {
+            alert("Initializing...");
+        } else if (event.type == MOTION_HOMED) {
+            initialized = event.ready;
+            bed.width = event.sizes[0];
+            bed.depth = event.sizes[1];
+            bed.height = event.sizes[2];
+
+            //Draw the screen again after we re-init
+            drawScreen();
+        }
+
+        printerGCode.sync(event);
+    }
+}
+
+void commandTaskLoop(void *arg) {
+    for (;;) {
+        readMotionEvents();
+
+        UdpMessage message;
+        while (udpMessages.pop(message))
+            processUdp(message);
+
+        readGCode();
+
+        //handle ir commands
+        if (IrReceiver.decode()) {
+            if (IrReceiver.decodedIRData.decodedRawData > 0) {
+                char code[9];
+                itoa(IrReceiver.decodedIRData.decodedRawData, code, 16);
+                performIRFunction(code);
+            }
+
+            IrReceiver.resume(); // Enable receiving of the next value
+        }
+
+        if (digitalRead(Button1) == LOW) {
+            Serial.println("Redrawing screen...");
+
+            //The switches sit on the motion side's I2C bus
+            sendMotion(MOTION_REPORT_SWITCHES);
+
+            drawScreen("Message");
+
+            delay(500);
+        }
+
+        runtime++;
+
+        //Give the idle task a look in so the watchdog stays quiet
+        vTaskDelay(1);
+    }
+}
+
 void connectToWifi() {
     WiFi.mode(WIFI_STA);
 
@@ -516,7 +1422,7 @@ void setup() {
         Serial.println("UDP listening locally on IP \"" + LocalIP.toString() + ":" + 4225 + "\"");
         UDP.onPacket([](AsyncUDPPacket packet) {
             Serial.println("Received UDP Packet. Processing...");
-            processUdp(packet);
+            receiveUdp(packet);
         });
     }
 
@@ -536,6 +1442,10 @@ void setup() {
     motors[0].pins[2] = 2;
     motors[0].pins[3] = 3;
     motors[0].reverseDirection = true;
+    motors[0].stepsPerMm = 1; //Set from the drive train, 1 keeps commands in steps
+    motors[0].holdTime = 2000000; //Runs level, nothing drags the head along once it has stopped
+    motors[0].backlash = 0; //mm, measure by reversing onto a dial indicator
+    motors[0].shaper = SHAPER_NONE; //Measure the ringing frequency before turning on, then acceleration can go up
     motors[0].init();
 
     //Y Axis - Backwards/Forwards
@@ -547,6 +1457,10 @@ void setup() {
     motors[1].pins[2] = 6;
     motors[1].pins[3] = 7;
     motors[1].reverseDirection = true;
+    motors[1].stepsPerMm = 1; //Set from the drive train, 1 keeps commands in steps
+    motors[1].holdTime = 2000000; //Level as well, 2s lets it settle after a move before it goes slack
+    motors[1].backlash = 0; //mm, measure by reversing onto a dial indicator
+    motors[1].shaper = SHAPER_NONE; //Measure the ringing frequency before turning on, then acceleration can go up
     motors[1].init();
 
     //Z Axis - Up/Down
@@ -557,102 +1471,30 @@ void setup() {
     motors[2].pins[2] = 25;
     motors[2].pins[3] = 33;
     motors[2].reverseDirection = true;
+    motors[2].stepsPerMm = 1; //Set from the drive train, 1 keeps commands in steps
+    motors[2].holdTime = 0; //Holds the pen up against gravity, letting go would drop it onto the work
+    motors[2].backlash = 0; //mm, measure by reversing onto a dial indicator
     motors[2].init(32, 200);
-}
-
-void loop() {
-    //Tne global increment value for our steppers
-    int increment = 1;
-    int motorIndex = 0;
-    for (auto & motor : motors) {
-        if (motor.scrolling) {
-
-            //If the motor is moving forward and is at or past its destination,
-            //Or if the motor is moving backwards and is at or in front of its destination,
-            if (motor.lastPosition < motor.position && motor.position >= motor.destination ||
-                motor.lastPosition > motor.position && motor.position <= motor.destination) {
 
-                Serial.println("Last: " + String(motor.lastPosition) + " | Current: " + String(motor.position));
+    cache.load();
 
-                motor.endScroll();
-            } else {
-                float xIncrement = 1;
-                float yIncrement = 1;
-
-                Serial.println("updating motor destination from " + String(motor.position) + " to " + String(motor.destination));
-
-                //If this isn't our vertical axis then normalize our diagonal movement
-                if (motorIndex != 2) {
-
-                    //pos1 = 25 | dest1 = 32
-                    //pos2 = 20 | dest2 = 35
-                    //7 > 15
-                    float xDiff = abs(motors[0].destination - motors[0].position); // 7
-                    float yDiff = abs(motors[1].destination - motors[1].position); // 15
-                    //x is bigger get y in pieces
-                    if (xDiff > yDiff) {
-                        yIncrement = yDiff / xDiff; //Only move  y by this amount
-                    } else {
-                        xIncrement = xDiff / yDiff;
-                    }
-                }
-
-                if (motor.destination > motor.position) {
-                    switch (motorIndex) {
-                        case 0:
-                            motor.changePosition(xIncrement);
-                            break;
-                        case 1:
-                            motor.changePosition(yIncrement);
-                            break;
-                        case 2:
-                        default:
-                            motor.changePosition(increment);
-                            break;
-                    }
-
-                } else {
-                    switch (motorIndex) {
-                        case 0:
-                            motor.changePosition(-xIncrement);
-                            break;
-                        case 1:
-                            motor.changePosition(-yIncrement);
-                            break;
-                        case 2:
-                        default:
-                            motor.changePosition(-increment);
-                            break;
-                    }
-                }
-            }
-        }
-
-        motorIndex++;
-    }
-
-//    handle ir commands
-    if (IrReceiver.decode()) {
-        if (IrReceiver.decodedIRData.decodedRawData > 0) {
-            char code[9];
-            itoa(IrReceiver.decodedIRData.decodedRawData, code, 16);
-            performIRFunction(code);
-        }
+    //Limit switches interrupt through the MCP rather than being polled over I2C
+    homing.begin(mcp, HOMING_INTERRUPT_PIN, stepAxis);
+    for (int i = 0; i < AXIS_COUNT; i++)
+        homing.setAxis(i, motors[i].switches[0], motors[i].switches[1], 1000000 / motors[i].maxVelocity);
 
-        IrReceiver.resume(); // Enable receiving of the next value
-    }
-
-    if (digitalRead(Button1) == LOW) {
-        Serial.println("Redrawing screen...");
-
-        Serial.println("Switch set 8:" + String(mcp.digitalRead(8)) + " | 9: " + String(mcp.digitalRead(9)));
-        Serial.println("Switch set 10: " + String(mcp.digitalRead(10)) + " | 11: " + String(mcp.digitalRead(11)));
-        Serial.println("Switch set 12: " + String(mcp.digitalRead(12)) + " | 13: " + String(mcp.digitalRead(13)));
-
-        drawScreen("Message");
-
-        delay(500);
+    //Motion and stepping get a core to themselves, commands, reporting and the display take the other
+    for (int i = 0; i < AXIS_COUNT; i++) {
+        Scheduler.setLimits(i, motors[i].maxVelocity, motors[i].acceleration, motors[i].jerk);
+        Scheduler.setBacklash(i, motors[i].toSteps(motors[i].backlash));
+        if (!Scheduler.setShaper(i, motors[i].shaper, motors[i].shaperFrequency, motors[i].shaperDamping))
+            Serial.println("Input shaper for axis " + String(i) + " doesn't fit, running it unshaped");
     }
+    xTaskCreatePinnedToCore(motionTaskLoop, "motion", 8192, NULL, 2, NULL, MOTION_CORE);
+    xTaskCreatePinnedToCore(commandTaskLoop, "commands", 8192, NULL, 1, NULL, COMMAND_CORE);
+}
 
-    runtime++;
-}
\ No newline at end of file
+void loop() {
+    //Everything runs in the motion and command tasks
+    vTaskDelete(NULL);
+}
@@ -0,0 +1,143 @@
+#ifndef Arduino_h
+#define Arduino_h
+
+/*
+ * Just enough of the Arduino core to build the motion code and its libraries
+ * for the native test env. Everything is header only so each test suite links
+ * on its own.
+ *
+ * Time only moves when something looks at it. Each micros() call moves the
+ * clock on by FAKE_MICROS_PER_CALL, so loops that spin on it still get
+ * somewhere, and fake::advance() jumps it forward.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+#define FAKE_MICROS_PER_CALL 1
+#define FAKE_PIN_COUNT 64
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+#define CHANGE 0x03
+#define FALLING 0x02
+#define RISING 0x01
+
+#define IRAM_ATTR
+#define F(string) string
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+enum BitOrder { LSBFIRST = 0, MSBFIRST = 1 };
+
+#define DEC 10
+#define HEX 16
+
+//Serial output goes nowhere, tests report through Unity
+class Stream {
+public:
+    void begin(unsigned long) {}
+    template <typename T> size_t print(T) { return 0; }
+    template <typename T> size_t print(T, int) { return 0; }
+    template <typename T> size_t println(T) { return 0; }
+    template <typename T> size_t println(T, int) { return 0; }
+    size_t println() { return 0; }
+};
+
+inline Stream &fakeSerial() {
+    static Stream serial;
+    return serial;
+}
+
+#define Serial (fakeSerial())
+
+namespace fake {
+    struct Board {
+        unsigned long now = 0;
+        uint8_t levels[FAKE_PIN_COUNT] = {0};
+        void (*interrupts[FAKE_PIN_COUNT])() = {nullptr};
+        int interruptModes[FAKE_PIN_COUNT] = {0};
+    };
+
+    inline Board &board() {
+        static Board board;
+        return board;
+    }
+
+    inline void advance(unsigned long us) {
+        board().now += us;
+    }
+
+    //Drives an input pin from outside, firing its interrupt like the hardware would
+    inline void setPin(uint8_t pin, uint8_t level) {
+        Board &b = board();
+        uint8_t was = b.levels[pin];
+        b.levels[pin] = level;
+        if (b.interrupts[pin] == nullptr || was == level)
+            return;
+
+        int mode = b.interruptModes[pin];
+        if (mode == CHANGE || (mode == FALLING && level == LOW) || (mode == RISING && level == HIGH))
+            b.interrupts[pin]();
+    }
+
+    inline void reset() {
+        board() = Board();
+    }
+}
+
+inline unsigned long micros() {
+    return fake::board().now += FAKE_MICROS_PER_CALL;
+}
+
+inline unsigned long millis() {
+    return micros() / 1000;
+}
+
+inline void delay(unsigned long ms) {
+    fake::advance(ms * 1000);
+}
+
+inline void delayMicroseconds(unsigned int us) {
+    fake::advance(us);
+}
+
+inline void pinMode(uint8_t, uint8_t) {}
+
+inline void digitalWrite(uint8_t pin, uint8_t level) {
+    fake::board().levels[pin] = level;
+}
+
+inline int digitalRead(uint8_t pin) {
+    return fake::board().levels[pin];
+}
+
+inline uint8_t digitalPinToInterrupt(uint8_t pin) {
+    return pin;
+}
+
+inline void attachInterrupt(uint8_t interrupt, void (*isr)(), int mode) {
+    fake::board().interrupts[interrupt] = isr;
+    fake::board().interruptModes[interrupt] = mode;
+}
+
+inline void detachInterrupt(uint8_t interrupt) {
+    fake::board().interrupts[interrupt] = nullptr;
+}
+
+inline void yield() {}
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef FakeMcp23017_h
+#define FakeMcp23017_h
+
+#include <Arduino.h>
+#include <Wire.h>
+
+//Register addresses with IOCON.BANK = 0, port A and B interleaved
+#define FAKE_MCP_IODIR 0x00
+#define FAKE_MCP_IPOL 0x02
+#define FAKE_MCP_GPINTEN 0x04
+#define FAKE_MCP_DEFVAL 0x06
+#define FAKE_MCP_INTCON 0x08
+#define FAKE_MCP_IOCON 0x0A
+#define FAKE_MCP_GPPU 0x0C
+#define FAKE_MCP_INTF 0x0E
+#define FAKE_MCP_INTCAP 0x10
+#define FAKE_MCP_GPIO 0x12
+#define FAKE_MCP_OLAT 0x14
+#define FAKE_MCP_REGISTERS 0x16
+
+/*
+ * An MCP23017 on the fake I2C bus, register for register as far as the
+ * drivers here use it: sequential access, OLAT behind GPIO writes, and
+ * interrupts on change or against DEFVAL with INTCAP capture, mirrored onto
+ * one interrupt pin of the fake board.
+ *
+ * Inputs are driven with setInput(). registerWrites counts bytes landing in
+ * each register so tests can see what was actually written.
+ */
+class FakeMcp23017 : public FakeI2CDevice {
+public:
+    uint8_t registers[FAKE_MCP_REGISTERS] = {0};
+    uint32_t registerWrites[FAKE_MCP_REGISTERS] = {0};
+
+    FakeMcp23017() {
+        //Power on state, everything an input
+        registers[FAKE_MCP_IODIR] = registers[FAKE_MCP_IODIR + 1] = 0xFF;
+    }
+
+    //Put the chip on the bus, with its interrupt output on the given board pin
+    void attach(TwoWire &wire, uint8_t address, uint8_t interruptPin) {
+        this->interruptPin = interruptPin;
+        wire.attach(address, this);
+        update();
+    }
+
+    //Level on an input pin, the pull-ups are assumed to be wired in
+    void setInput(uint8_t pin, uint8_t level) {
+        if (level)
+            inputs |= 1 << pin;
+        else
+            inputs &= ~(1 << pin);
+        update();
+    }
+
+    //Both ports as a 16 bit value, port A in the low byte
+    uint16_t port(uint8_t base) {
+        return registers[base] | registers[base + 1] << 8;
+    }
+
+    void receive(const uint8_t *data, size_t length) override {
+        pointer = data[0] % FAKE_MCP_REGISTERS;
+        for (size_t i = 1; i < length; i++) {
+            write(pointer, data[i]);
+            pointer = (pointer + 1) % FAKE_MCP_REGISTERS;
+        }
+        update();
+    }
+
+    uint8_t send() override {
+        uint8_t value = read(pointer);
+        pointer = (pointer + 1) % FAKE_MCP_REGISTERS;
+        update();
+        return value;
+    }
+
+private:
+    uint16_t inputs = 0xFFFF;
+    uint16_t lastPins = 0xFFFF;
+    uint8_t pointer = 0;
+    uint8_t interruptPin = 0;
+
+    uint16_t pins() {
+        uint16_t direction = port(FAKE_MCP_IODIR);
+        uint16_t levels = (inputs & direction) | (port(FAKE_MCP_OLAT) & ~direction);
+        return levels ^ (port(FAKE_MCP_IPOL) & direction);
+    }
+
+    void write(uint8_t reg, uint8_t value) {
+        registerWrites[reg]++;
+        uint8_t base = reg & ~1;
+        if (base == FAKE_MCP_INTF || base == FAKE_MCP_INTCAP)
+            return;
+
+        //GPIO writes land in the latch, and IOCON is one register at both addresses
+        if (base == FAKE_MCP_GPIO)
+            reg += FAKE_MCP_OLAT - FAKE_MCP_GPIO;
+        if (base == FAKE_MCP_IOCON)
+            registers[FAKE_MCP_IOCON] = registers[FAKE_MCP_IOCON + 1] = value;
+        else
+            registers[reg] = value;
+    }
+
+    uint8_t read(uint8_t reg) {
+        uint8_t base = reg & ~1;
+        uint8_t port = reg & 1;
+        if (base == FAKE_MCP_GPIO)
+            registers[reg] = port ? pins() >> 8 : pins() & 0xFF;
+
+        uint8_t value = registers[reg];
+
+        //Reading the capture or the port clears that port's interrupt
+        if (base == FAKE_MCP_INTCAP || base == FAKE_MCP_GPIO)
+            registers[FAKE_MCP_INTF + port] = 0;
+        return value;
+    }
+
+    void update() {
+        uint16_t now = pins();
+        uint16_t enabled = port(FAKE_MCP_GPINTEN);
+        uint16_t compare = port(FAKE_MCP_INTCON);
+        uint16_t against = (compare & port(FAKE_MCP_DEFVAL)) | (~compare & lastPins);
+        uint16_t firing = enabled & (now ^ against);
+        lastPins = now;
+
+        for (uint8_t p = 0; p < 2; p++) {
+            uint8_t bits = firing >> (8 * p);
+            if (bits == 0 || registers[FAKE_MCP_INTF + p] != 0)
+                continue;
+
+            registers[FAKE_MCP_INTF + p] = bits;
+            registers[FAKE_MCP_INTCAP + p] = now >> (8 * p);
+        }
+
+        bool mirror = registers[FAKE_MCP_IOCON] & (1 << 6);
+        bool activeHigh = registers[FAKE_MCP_IOCON] & (1 << 1);
+        bool active = mirror ? (registers[FAKE_MCP_INTF] || registers[FAKE_MCP_INTF + 1]) : registers[FAKE_MCP_INTF];
+        fake::setPin(interruptPin, active == activeHigh ? HIGH : LOW);
+    }
+};
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef SPI_h
+#define SPI_h
+
+#include <Arduino.h>
+
+/*
+ * Nothing in the native tests talks SPI, this only lets Adafruit BusIO build.
+ */
+
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x01
+#define SPI_MODE2 0x02
+#define SPI_MODE3 0x03
+
+class SPISettings {
+public:
+    SPISettings() {}
+    SPISettings(uint32_t, BitOrder, uint8_t) {}
+    SPISettings(uint32_t, uint8_t, uint8_t) {}
+};
+
+class SPIClass {
+public:
+    void begin() {}
+    void end() {}
+    void beginTransaction(SPISettings) {}
+    void endTransaction() {}
+    uint8_t transfer(uint8_t) { return 0xFF; }
+    void transfer(void *, size_t) {}
+};
+
+inline SPIClass &fakeSPI() {
+    static SPIClass spi;
+    return spi;
+}
+
+#define SPI (fakeSPI())
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef TwoWire_h
+#define TwoWire_h
+
+#include <Arduino.h>
+
+#define FAKE_WIRE_BUFFER 32
+
+/*
+ * Something answering on the fake I2C bus. Writes arrive a whole
+ * transmission at a time, reads a byte at a time.
+ */
+class FakeI2CDevice {
+public:
+    virtual ~FakeI2CDevice() {}
+    virtual void receive(const uint8_t *data, size_t length) = 0;
+    virtual uint8_t send() = 0;
+};
+
+/*
+ * I2C bus with one device on it, counting every transaction so tests can see
+ * what a piece of code costs on the bus.
+ */
+class TwoWire {
+public:
+    FakeI2CDevice *device = nullptr;
+    uint8_t deviceAddress = 0;
+
+    uint32_t writes = 0;    //Transmissions ended
+    uint32_t reads = 0;     //Requests made
+    uint32_t bytes = 0;     //Bytes either way, not counting addresses
+
+    void attach(uint8_t address, FakeI2CDevice *device) {
+        this->deviceAddress = address;
+        this->device = device;
+    }
+    uint32_t transactions() { return writes + reads; }
+    void resetCounts() { writes = reads = bytes = 0; }
+
+    void begin() {}
+    void end() {}
+    void setClock(uint32_t) {}
+
+    void beginTransmission(uint8_t address) {
+        target = address;
+        length = 0;
+    }
+    size_t write(uint8_t data) {
+        if (length >= FAKE_WIRE_BUFFER)
+            return 0;
+
+        buffer[length++] = data;
+        return 1;
+    }
+    size_t write(const uint8_t *data, size_t count) {
+        size_t written = 0;
+        while (written < count && write(data[written]))
+            written++;
+        return written;
+    }
+    uint8_t endTransmission(bool stop = true) {
+        (void)stop;
+        writes++;
+        bytes += length;
+        if (device == nullptr || target != deviceAddress)
+            return 2; //NACK on the address
+
+        if (length > 0)
+            device->receive(buffer, length);
+        return 0;
+    }
+    size_t requestFrom(uint8_t address, size_t count, bool stop = true) {
+        (void)stop;
+        reads++;
+        available_ = 0;
+        position = 0;
+        if (device == nullptr || address != deviceAddress)
+            return 0;
+
+        for (size_t i = 0; i < count && i < FAKE_WIRE_BUFFER; i++)
+            buffer[available_++] = device->send();
+        bytes += available_;
+        return available_;
+    }
+    int available() { return available_ - position; }
+    int read() { return position < available_ ? buffer[position++] : -1; }
+
+private:
+    uint8_t buffer[FAKE_WIRE_BUFFER] = {0};
+    size_t length = 0;
+    size_t available_ = 0;
+    size_t position = 0;
+    uint8_t target = 0;
+};
+
+inline TwoWire &fakeWire() {
+    static TwoWire wire;
+    return wire;
+}
+
+#define Wire (fakeWire())
+
+#endif
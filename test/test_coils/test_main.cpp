@@ -0,0 +1,256 @@
+#include <unity.h>
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <Stepper.h>
+#include <Adafruit_MCP23X17.h>
+#include <FakeMcp23017.h>
+#include "StepScheduler.h"
+
+/*
+ * Counts the I2C transactions MCP motors cost, on a bus that counts every
+ * write and read against a fake MCP23017. The motors are wired like the
+ * printer's X and Y, sharing port A, plus a third on port B.
+ */
+
+#define MCP_ADDRESS 0x20
+#define STEPS 200
+#define HOLD_TIME_US 1000
+
+static FakeMcp23017 *chip;
+static Adafruit_MCP23X17 *mcp;
+static Stepper *x;
+static Stepper *y;
+static Stepper *b;
+
+//The scheduler's view of the motors, and what the latch held at the end of every tick
+static StepScheduler *scheduler;
+static Stepper *axes[AXIS_COUNT];
+static uint8_t frames[400];
+static uint32_t frameWrites[400];
+static uint16_t frameCount;
+
+//The chip's output latch for a motor's four pins, first pin in the top bit like the phase patterns
+static uint8_t coils(uint8_t firstPin) {
+    uint16_t latch = chip->port(FAKE_MCP_OLAT);
+    uint8_t pattern = 0;
+    for (uint8_t i = 0; i < 4; i++)
+        pattern = pattern << 1 | ((latch >> (firstPin + i)) & 1);
+    return pattern;
+}
+
+void setUp() {
+    fake::reset();
+    chip = new FakeMcp23017();
+    chip->attach(Wire, MCP_ADDRESS, 0);
+
+    mcp = new Adafruit_MCP23X17();
+    TEST_ASSERT_TRUE(mcp->begin_I2C(MCP_ADDRESS, &Wire));
+
+    x = new Stepper(STEPS, 0, 1, 2, 3, true, *mcp);
+    y = new Stepper(STEPS, 4, 5, 6, 7, true, *mcp);
+    b = new Stepper(STEPS, 8, 9, 10, 11, true, *mcp);
+    Stepper *motors[] = {x, y, b};
+    for (Stepper *motor : motors)
+        motor->setHoldTime(HOLD_TIME_US);
+
+    Wire.resetCounts();
+}
+
+void tearDown() {
+    delete b;
+    delete y;
+    delete x;
+    delete mcp;
+    delete chip;
+}
+
+void test_one_write_per_step() {
+    uint8_t last = coils(0);
+    for (int i = 0; i < 40; i++) {
+        uint32_t before = Wire.transactions();
+        x->stepNow(i < 20);
+        TEST_ASSERT_EQUAL_UINT32(1, Wire.transactions() - before);
+
+        //And the coils really moved on a phase
+        TEST_ASSERT_TRUE(coils(0) != last);
+        last = coils(0);
+    }
+
+    //Nothing was read back to work out the other pins on the port
+    TEST_ASSERT_EQUAL_UINT32(0, Wire.reads);
+    TEST_ASSERT_EQUAL_UINT32(0, coils(4));
+}
+
+void test_one_transaction_per_tick() {
+    for (int i = 0; i < 20; i++) {
+        uint32_t before = Wire.transactions();
+
+        //What the step task does with a tick that steps X and Y, they share port A
+        mcp->setWriteThrough(false);
+        x->stepNow(true);
+        y->stepNow(false);
+        TEST_ASSERT_EQUAL_UINT32(before, Wire.transactions());
+        mcp->setWriteThrough(true);
+
+        TEST_ASSERT_EQUAL_UINT32(1, Wire.transactions() - before);
+    }
+
+    //Both ports changing still go in one write
+    uint32_t before = Wire.transactions();
+    mcp->setWriteThrough(false);
+    x->stepNow(true);
+    b->stepNow(true);
+    mcp->setWriteThrough(true);
+    TEST_ASSERT_EQUAL_UINT32(1, Wire.transactions() - before);
+    TEST_ASSERT_TRUE(coils(8) != 0);
+    TEST_ASSERT_EQUAL_UINT32(0, Wire.reads);
+}
+
+void test_idle_ticks_cost_nothing() {
+    x->stepNow(true);
+    y->stepNow(true);
+
+    //Ticks with nothing to do, the motors still within their hold time
+    uint32_t before = Wire.transactions();
+    for (int i = 0; i < 10; i++) {
+        mcp->setWriteThrough(false);
+        x->releaseIfIdle(micros());
+        y->releaseIfIdle(micros());
+        mcp->setWriteThrough(true);
+    }
+    TEST_ASSERT_EQUAL_UINT32(before, Wire.transactions());
+
+    //Both let go in the same tick, one write
+    fake::advance(HOLD_TIME_US);
+    mcp->setWriteThrough(false);
+    TEST_ASSERT_TRUE(x->releaseIfIdle(micros()));
+    TEST_ASSERT_TRUE(y->releaseIfIdle(micros()));
+    mcp->setWriteThrough(true);
+    TEST_ASSERT_EQUAL_UINT32(1, Wire.transactions() - before);
+    TEST_ASSERT_EQUAL_UINT8(0, coils(0));
+    TEST_ASSERT_EQUAL_UINT8(0, coils(4));
+
+    //Already released, nothing more to write
+    before = Wire.transactions();
+    x->release();
+    mcp->setWriteThrough(false);
+    x->releaseIfIdle(micros());
+    mcp->setWriteThrough(true);
+    TEST_ASSERT_EQUAL_UINT32(before, Wire.transactions());
+}
+
+//What main's scheduleStep() and finishTick() do, one MCP frame per tick
+static bool frameStep(uint8_t axis, bool forward) {
+    mcp->setWriteThrough(false);
+    return axes[axis]->stepNow(forward);
+}
+
+static void frameEnd(uint32_t now) {
+    mcp->setWriteThrough(false);
+    for (Stepper *motor : axes)
+        motor->releaseIfIdle(micros());
+    mcp->setWriteThrough(true);
+
+    if (frameCount < sizeof(frames)) {
+        frames[frameCount] = coils(0);
+        frameWrites[frameCount++] = Wire.transactions();
+    }
+    fake::advance(STEP_TICK_US);
+}
+
+static void runFrames(uint32_t us) {
+    frameCount = 0;
+    scheduler->run(us);
+}
+
+void test_release_wakes_before_stepping() {
+    x->stepNow(true);
+    x->stepNow(true);
+    uint8_t held = coils(0);
+
+    fake::advance(HOLD_TIME_US);
+    TEST_ASSERT_TRUE(x->releaseIfIdle(micros()));
+    TEST_ASSERT_EQUAL_UINT8(0, coils(0));
+
+    //The first step after a release only drives the phase the rotor was left on, in its own tick
+    uint32_t before = Wire.transactions();
+    mcp->setWriteThrough(false);
+    TEST_ASSERT_FALSE(x->stepNow(true));
+    mcp->setWriteThrough(true);
+    TEST_ASSERT_EQUAL_UINT32(1, Wire.transactions() - before);
+    TEST_ASSERT_EQUAL_UINT8(held, coils(0));
+    TEST_ASSERT_EQUAL_INT32(2, x->currentPosition());
+
+    //The step it was offered goes out on the next tick, one phase on
+    before = Wire.transactions();
+    mcp->setWriteThrough(false);
+    TEST_ASSERT_TRUE(x->stepNow(true));
+    mcp->setWriteThrough(true);
+    TEST_ASSERT_EQUAL_UINT32(1, Wire.transactions() - before);
+    TEST_ASSERT_TRUE(coils(0) != held && coils(0) != 0);
+    TEST_ASSERT_EQUAL_INT32(3, x->currentPosition());
+}
+
+void test_tick_wakes_then_steps_a_delay_later() {
+    x->setSpeed(60); //5000 us a step at 200 steps/rev
+    x->stepNow(true);
+    uint8_t held = coils(0);
+    x->release();
+    fake::advance(10000);
+
+    //Starting again only wakes the coils, the step waits out a step delay on the held phase
+    unsigned long now = micros();
+    x->move(1);
+    TEST_ASSERT_FALSE(x->tick(now));
+    TEST_ASSERT_EQUAL_UINT8(held, coils(0));
+    TEST_ASSERT_FALSE(x->tick(now + 4999));
+    TEST_ASSERT_EQUAL_UINT8(held, coils(0));
+    TEST_ASSERT_TRUE(x->tick(now + 5000));
+    TEST_ASSERT_EQUAL_INT32(2, x->currentPosition());
+}
+
+void test_scheduled_wake_gets_its_own_frame() {
+    scheduler = new StepScheduler();
+    axes[0] = x;
+    axes[1] = y;
+    axes[2] = b;
+    scheduler->attach(frameStep);
+    scheduler->attachTick(frameEnd);
+    for (uint8_t axis = 0; axis < AXIS_COUNT; axis++)
+        scheduler->setLimits(axis, 1000, 10000);
+
+    int32_t out[AXIS_COUNT] = {4, 0, 0};
+    scheduler->queueLine(out);
+    runFrames(20000);
+    uint8_t held = frames[frameCount - 1];
+    TEST_ASSERT_EQUAL_UINT8(held, coils(0));
+
+    //Past the hold time the coils let go
+    runFrames(HOLD_TIME_US + STEP_TICK_US);
+    TEST_ASSERT_EQUAL_UINT8(0, coils(0));
+
+    //Going again, the latch goes 0, the held phase in a frame of its own, then on a phase a tick later
+    uint32_t before = Wire.transactions();
+    scheduler->queueLine(out);
+    runFrames(20000);
+    TEST_ASSERT_EQUAL_UINT8(held, frames[0]);
+    TEST_ASSERT_EQUAL_UINT32(1, frameWrites[0] - before);
+    TEST_ASSERT_TRUE(frames[1] != held && frames[1] != 0);
+    TEST_ASSERT_EQUAL_UINT32(1, frameWrites[1] - frameWrites[0]);
+    TEST_ASSERT_EQUAL_INT32(8, x->currentPosition());
+    TEST_ASSERT_EQUAL_INT32(8, scheduler->getShapedPosition(0));
+
+    delete scheduler;
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_one_write_per_step);
+    RUN_TEST(test_one_transaction_per_tick);
+    RUN_TEST(test_idle_ticks_cost_nothing);
+    RUN_TEST(test_release_wakes_before_stepping);
+    RUN_TEST(test_tick_wakes_then_steps_a_delay_later);
+    RUN_TEST(test_scheduled_wake_gets_its_own_frame);
+    return UNITY_END();
+}
@@ -0,0 +1,209 @@
+#include <unity.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "GCodeInterpreter.h"
+
+//Feeds G-code through the interpreter into a machine that records what it's asked to do
+
+struct FakeMachine : GCodeMachine {
+    float positions[AXIS_COUNT] = {0};
+    bool ready = true;   //False to push back like a full motion queue
+    int lines = 0;
+    int arcs = 0;
+    int mCodes = 0;
+    float lastFeedRate = 0;
+
+    float getPosition(uint8_t axis) override {
+        return positions[axis];
+    }
+    bool line(const float target[AXIS_COUNT], float feedRate) override {
+        if (!ready)
+            return false;
+
+        lines++;
+        lastFeedRate = feedRate;
+        memcpy(positions, target, sizeof(positions));
+        return true;
+    }
+    bool arc(const float target[AXIS_COUNT], float centreX, float centreY, bool clockwise, float feedRate) override {
+        if (!ready)
+            return false;
+
+        arcs++;
+        memcpy(positions, target, sizeof(positions));
+        return true;
+    }
+    bool home() override {
+        return ready;
+    }
+    bool mCode(uint16_t code, bool hasS, float s) override {
+        if (!ready)
+            return false;
+
+        mCodes++;
+        return true;
+    }
+};
+
+static FakeMachine machine;
+static GCodeInterpreter *gcode;
+
+//Feed a whole line, newline included, returning the status it completed with
+static GCodeStatus send(const char *text) {
+    for (const char *p = text; *p; p++)
+        gcode->feed(*p);
+    return gcode->feed('\n');
+}
+
+//Frame a line as "N<number> <text>*<checksum>", the way a host streaming with resends would
+static GCodeStatus sendNumbered(int32_t number, const char *text, int checksumError = 0) {
+    char framed[GCODE_LINE_LENGTH];
+    int length = snprintf(framed, sizeof(framed), "N%ld %s", (long)number, text);
+
+    uint8_t sum = 0;
+    for (int i = 0; i < length; i++)
+        sum ^= (uint8_t)framed[i];
+
+    snprintf(framed + length, sizeof(framed) - length, "*%d", (sum + checksumError) & 0xFF);
+    return send(framed);
+}
+
+void setUp() {
+    machine = FakeMachine();
+    gcode = new GCodeInterpreter(machine);
+}
+
+void tearDown() {
+    delete gcode;
+}
+
+void test_moves_reach_the_machine() {
+    TEST_ASSERT_EQUAL(GCODE_OK, send("G1 X10 Y-5.5 F600"));
+    TEST_ASSERT_EQUAL(1, machine.lines);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, 10, machine.positions[0]);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, -5.5f, machine.positions[1]);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, 10, machine.lastFeedRate);
+
+    //Negative targets are targets like any other, and unmentioned axis stay put
+    TEST_ASSERT_EQUAL(GCODE_OK, send("G91"));
+    TEST_ASSERT_EQUAL(GCODE_OK, send("G1 Z-1"));
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, -1, machine.positions[2]);
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, 10, machine.positions[0]);
+}
+
+void test_checksum() {
+    TEST_ASSERT_EQUAL(GCODE_OK, sendNumbered(1, "G1 X1"));
+    TEST_ASSERT_EQUAL(GCODE_ERROR_CHECKSUM, sendNumbered(2, "G1 X2", 1));
+    TEST_ASSERT_EQUAL(1, machine.lines);
+    TEST_ASSERT_EQUAL_INT32(1, gcode->getLineNumber());
+
+    //The resend goes through
+    TEST_ASSERT_EQUAL(GCODE_OK, sendNumbered(2, "G1 X2"));
+    TEST_ASSERT_EQUAL(2, machine.lines);
+    TEST_ASSERT_EQUAL(GCODE_ERROR_CHECKSUM, send("N3 G1 X3*"));
+}
+
+void test_line_numbers_and_resync() {
+    TEST_ASSERT_EQUAL(GCODE_OK, sendNumbered(1, "G1 X1"));
+
+    //A skipped line is refused without moving, so the host resends from the one after the last good line
+    TEST_ASSERT_EQUAL(GCODE_ERROR_LINE_NUMBER, sendNumbered(3, "G1 X3"));
+    TEST_ASSERT_EQUAL_INT32(1, gcode->getLineNumber());
+    TEST_ASSERT_EQUAL(1, machine.lines);
+    TEST_ASSERT_EQUAL(GCODE_OK, sendNumbered(2, "G1 X2"));
+
+    //M110 sets the number rather than following it
+    TEST_ASSERT_EQUAL(GCODE_OK, sendNumbered(100, "M110"));
+    TEST_ASSERT_EQUAL_INT32(100, gcode->getLineNumber());
+    TEST_ASSERT_EQUAL(0, machine.mCodes);
+    TEST_ASSERT_EQUAL(GCODE_ERROR_LINE_NUMBER, sendNumbered(3, "G1 X3"));
+    TEST_ASSERT_EQUAL(GCODE_OK, sendNumbered(101, "G1 X3"));
+    TEST_ASSERT_EQUAL(3, machine.lines);
+}
+
+void test_pending_back_pressure() {
+    machine.ready = false;
+    TEST_ASSERT_EQUAL(GCODE_PENDING, send("G1 X5 Y5"));
+
+    //Nothing more is taken while the line waits, and retrying doesn't run it twice
+    TEST_ASSERT_EQUAL(GCODE_PENDING, gcode->feed('G'));
+    TEST_ASSERT_EQUAL(GCODE_PENDING, gcode->poll());
+    TEST_ASSERT_EQUAL(GCODE_PENDING, gcode->poll());
+    TEST_ASSERT_EQUAL(0, machine.lines);
+
+    machine.ready = true;
+    TEST_ASSERT_EQUAL(GCODE_OK, gcode->poll());
+    TEST_ASSERT_EQUAL(GCODE_INCOMPLETE, gcode->poll());
+    TEST_ASSERT_EQUAL(1, machine.lines);
+    TEST_ASSERT_EQUAL(1, gcode->getLinesProcessed());
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, 5, machine.positions[0]);
+
+    //Relative moves read the position when they finally run, not when they were parsed
+    send("G91");
+    machine.ready = false;
+    TEST_ASSERT_EQUAL(GCODE_PENDING, send("G1 X1"));
+    TEST_ASSERT_EQUAL(GCODE_PENDING, gcode->poll());
+    machine.ready = true;
+    TEST_ASSERT_EQUAL(GCODE_OK, gcode->poll());
+    TEST_ASSERT_FLOAT_WITHIN(0.0001f, 6, machine.positions[0]);
+
+    //M codes are held back the same way
+    machine.ready = false;
+    TEST_ASSERT_EQUAL(GCODE_PENDING, send("M3 S100"));
+    machine.ready = true;
+    TEST_ASSERT_EQUAL(GCODE_OK, gcode->poll());
+    TEST_ASSERT_EQUAL(1, machine.mCodes);
+}
+
+void test_overflow_and_syntax() {
+    char longLine[GCODE_LINE_LENGTH + 20];
+    memset(longLine, 'X', sizeof(longLine) - 1);
+    longLine[sizeof(longLine) - 1] = '\0';
+    TEST_ASSERT_EQUAL(GCODE_ERROR_OVERFLOW, send(longLine));
+    TEST_ASSERT_EQUAL(GCODE_ERROR_SYNTAX, send("G1 X"));
+    TEST_ASSERT_EQUAL(GCODE_ERROR_UNSUPPORTED, send("G5 X1"));
+
+    //The interpreter picks up cleanly after errors
+    TEST_ASSERT_EQUAL(GCODE_OK, send("G1 X1 ; comment"));
+    TEST_ASSERT_EQUAL(1, machine.lines);
+}
+
+void test_g_numbers_are_not_truncated() {
+    //Each of these would land on a supported code if it were cut down to a byte
+    TEST_ASSERT_EQUAL(GCODE_ERROR_UNSUPPORTED, send("G284"));
+    TEST_ASSERT_EQUAL(GCODE_ERROR_UNSUPPORTED, send("G28.1"));
+    TEST_ASSERT_EQUAL(GCODE_ERROR_UNSUPPORTED, send("G256 X5"));
+    TEST_ASSERT_EQUAL(GCODE_ERROR_UNSUPPORTED, send("G257 X5"));
+    TEST_ASSERT_EQUAL(0, machine.lines);
+
+    //A numbered one still uses up its line number
+    TEST_ASSERT_EQUAL(GCODE_ERROR_UNSUPPORTED, sendNumbered(1, "G28.1"));
+    TEST_ASSERT_EQUAL(GCODE_OK, sendNumbered(2, "G1 X5"));
+    TEST_ASSERT_EQUAL(1, machine.lines);
+}
+
+void test_unsupported_lines_change_no_mode() {
+    //G91 is fine on its own, but the line it's on is refused so it mustn't take effect
+    TEST_ASSERT_EQUAL(GCODE_OK, send("G1 X10 F600"));
+    TEST_ASSERT_EQUAL(GCODE_ERROR_UNSUPPORTED, send("G91 G99 F1200"));
+    TEST_ASSERT_EQUAL(GCODE_ERROR_UNSUPPORTED, send("G0 G5"));
+
+    //Still absolute, still G1 at the old feed rate
+    TEST_ASSERT_EQUAL(GCODE_OK, send("X20"));
+    TEST_ASSERT_EQUAL(2, machine.lines);
+    TEST_ASSERT_EQUAL_FLOAT(20, machine.positions[0]);
+    TEST_ASSERT_EQUAL_FLOAT(10, machine.lastFeedRate);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_moves_reach_the_machine);
+    RUN_TEST(test_checksum);
+    RUN_TEST(test_line_numbers_and_resync);
+    RUN_TEST(test_pending_back_pressure);
+    RUN_TEST(test_overflow_and_syntax);
+    RUN_TEST(test_g_numbers_are_not_truncated);
+    RUN_TEST(test_unsupported_lines_change_no_mode);
+    return UNITY_END();
+}
@@ -0,0 +1,109 @@
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#include "GCodeInterpreter.h"
+
+/*
+ * Streams a large G-code file through the interpreter and reports lines/s.
+ *
+ * Set GCODE_BENCH_FILE to the file to stream, otherwise a drawing's worth of
+ * numbered, checksummed moves is made up on the fly. The machine takes
+ * everything straight away so only the parsing is timed.
+ */
+
+#define BENCH_LINES 200000
+
+struct NullMachine : GCodeMachine {
+    float positions[AXIS_COUNT] = {0};
+    uint32_t moves = 0;
+
+    float getPosition(uint8_t axis) override { return positions[axis]; }
+    bool line(const float target[AXIS_COUNT], float feedRate) override {
+        for (uint8_t i = 0; i < AXIS_COUNT; i++)
+            positions[i] = target[i];
+        moves++;
+        return true;
+    }
+    bool arc(const float target[AXIS_COUNT], float centreX, float centreY, bool clockwise, float feedRate) override {
+        return line(target, feedRate);
+    }
+    bool home() override { return true; }
+    bool mCode(uint16_t code, bool hasS, float s) override { return true; }
+};
+
+static char *stream = nullptr;
+static size_t streamLength = 0;
+
+static bool loadFile(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == nullptr)
+        return false;
+
+    fseek(file, 0, SEEK_END);
+    streamLength = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    stream = (char *)malloc(streamLength);
+    streamLength = fread(stream, 1, streamLength, file);
+    fclose(file);
+    return true;
+}
+
+//Numbered and checksummed like a host streaming with resends would send it
+static void synthesize() {
+    stream = (char *)malloc(BENCH_LINES * 64);
+    streamLength = 0;
+    for (int32_t n = 1; n <= BENCH_LINES; n++) {
+        char *line = stream + streamLength;
+        int length = snprintf(line, 64, "N%ld G1 X%.3f Y%.3f F%d", (long)n, (n % 2000) * 0.05f, (n % 1700) * -0.0625f, 1200 + n % 7);
+
+        uint8_t sum = 0;
+        for (int i = 0; i < length; i++)
+            sum ^= (uint8_t)line[i];
+
+        streamLength += length + snprintf(line + length, 64 - length, "*%d\n", sum);
+    }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_stream_throughput() {
+    const char *path = getenv("GCODE_BENCH_FILE");
+    if (path != nullptr) {
+        TEST_ASSERT_TRUE_MESSAGE(loadFile(path), "couldn't read GCODE_BENCH_FILE");
+    } else {
+        synthesize();
+    }
+
+    NullMachine machine;
+    GCodeInterpreter gcode(machine);
+    uint32_t errors = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < streamLength; i++) {
+        GCodeStatus status = gcode.feed(stream[i]);
+        if (status >= GCODE_ERROR_CHECKSUM)
+            errors++;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    char report[160];
+    snprintf(report, sizeof(report), "%lu lines (%lu moves, %lu errors) in %.3f s, %.0f lines/s, %.1f MB/s",
+             (unsigned long)gcode.getLinesProcessed(), (unsigned long)machine.moves, (unsigned long)errors,
+             seconds, gcode.getLinesProcessed() / seconds, streamLength / seconds / 1e6);
+    TEST_MESSAGE(report);
+
+    if (path == nullptr) {
+        TEST_ASSERT_EQUAL_UINT32(BENCH_LINES, gcode.getLinesProcessed());
+        TEST_ASSERT_EQUAL_UINT32(0, errors);
+    }
+    free(stream);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_stream_throughput);
+    return UNITY_END();
+}
@@ -0,0 +1,151 @@
+#include <unity.h>
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <FakeMcp23017.h>
+
+#include "Homing.h"
+#include "StepScheduler.h"
+
+/*
+ * Homing against carriages on a fake MCP23017, with a switch at each end of
+ * every axis. The switches close once the carriage reaches the end and the
+ * MCP raises its interrupt like the real one, so homing only sees them through
+ * the interrupt and the captured port.
+ */
+
+#define MCP_ADDRESS 0x20
+#define AXIS_LENGTH 8000
+#define STEP_INTERVAL 200
+
+static FakeMcp23017 *chip;
+static Adafruit_MCP23X17 *mcp;
+static Homing *homing;
+static int32_t carriages[AXIS_COUNT];
+
+static uint8_t minPin(uint8_t axis) { return 8 + 2 * axis; }
+static uint8_t maxPin(uint8_t axis) { return 9 + 2 * axis; }
+
+//Switches are active low, closed at and past the ends
+static void updateSwitches(uint8_t axis) {
+    chip->setInput(minPin(axis), carriages[axis] <= 0 ? LOW : HIGH);
+    chip->setInput(maxPin(axis), carriages[axis] >= AXIS_LENGTH ? LOW : HIGH);
+}
+
+static bool onStep(uint8_t axis, bool forward) {
+    carriages[axis] += forward ? 1 : -1;
+    updateSwitches(axis);
+    return true;
+}
+
+static void placeCarriages(const int32_t positions[AXIS_COUNT]) {
+    for (uint8_t axis = 0; axis < AXIS_COUNT; axis++) {
+        carriages[axis] = positions[axis];
+        updateSwitches(axis);
+    }
+}
+
+//What fastStart() does: run up to the margin from where the cache says we are, then touch
+static bool fastStart(const int32_t cached[AXIS_COUNT], int32_t approach[AXIS_COUNT]) {
+    StepScheduler scheduler;
+    scheduler.attach(onStep);
+
+    int32_t delta[AXIS_COUNT];
+    for (uint8_t axis = 0; axis < AXIS_COUNT; axis++) {
+        scheduler.setLimits(axis, 5000, 50000);
+        scheduler.setPosition(axis, cached[axis]);
+        approach[axis] = min(cached[axis], (int32_t)HOMING_VERIFY_MARGIN);
+        delta[axis] = approach[axis] - cached[axis];
+    }
+
+    scheduler.queueLine(delta);
+    while (scheduler.isBusy())
+        scheduler.run(1000);
+
+    return homing->run(false, 2 * HOMING_VERIFY_MARGIN);
+}
+
+void setUp() {
+    fake::reset();
+    Wire.resetCounts();
+    chip = new FakeMcp23017();
+    chip->attach(Wire, MCP_ADDRESS, HOMING_INTERRUPT_PIN);
+
+    mcp = new Adafruit_MCP23X17();
+    TEST_ASSERT_TRUE(mcp->begin_I2C(MCP_ADDRESS, &Wire));
+
+    homing = new Homing();
+    homing->begin(*mcp, HOMING_INTERRUPT_PIN, onStep);
+    for (uint8_t axis = 0; axis < AXIS_COUNT; axis++) {
+        mcp->pinMode(minPin(axis), INPUT_PULLUP);
+        mcp->pinMode(maxPin(axis), INPUT_PULLUP);
+        homing->setAxis(axis, minPin(axis), maxPin(axis), STEP_INTERVAL);
+    }
+}
+
+void tearDown() {
+    delete homing;
+    delete mcp;
+    delete chip;
+}
+
+void test_full_home_from_centre() {
+    const int32_t centre[AXIS_COUNT] = {AXIS_LENGTH / 2, AXIS_LENGTH / 3, 600};
+    placeCarriages(centre);
+
+    TEST_ASSERT_TRUE(homing->run(false));
+    for (uint8_t axis = 0; axis < AXIS_COUNT; axis++) {
+        TEST_ASSERT_INT32_WITHIN(1, -centre[axis], homing->getPosition(axis));
+        TEST_ASSERT_INT32_WITHIN(1, 0, homing->getSpread(axis));
+    }
+
+    TEST_ASSERT_TRUE(homing->run(true));
+    for (uint8_t axis = 0; axis < AXIS_COUNT; axis++)
+        TEST_ASSERT_INT32_WITHIN(1, AXIS_LENGTH, homing->getPosition(axis));
+}
+
+void test_cached_start_from_centre() {
+    //The cache is right, every axis comes to rest in the middle and touches together
+    const int32_t centre[AXIS_COUNT] = {AXIS_LENGTH / 2, AXIS_LENGTH / 2, AXIS_LENGTH / 2};
+    placeCarriages(centre);
+
+    int32_t approach[AXIS_COUNT];
+    TEST_ASSERT_TRUE(fastStart(centre, approach));
+    for (uint8_t axis = 0; axis < AXIS_COUNT; axis++)
+        TEST_ASSERT_INT32_WITHIN(HOMING_VERIFY_TOLERANCE, -approach[axis], homing->getPosition(axis));
+}
+
+void test_cached_start_from_inside_the_margin() {
+    const int32_t near[AXIS_COUNT] = {10, HOMING_VERIFY_MARGIN, 3000};
+    placeCarriages(near);
+
+    int32_t approach[AXIS_COUNT];
+    TEST_ASSERT_TRUE(fastStart(near, approach));
+    for (uint8_t axis = 0; axis < AXIS_COUNT; axis++)
+        TEST_ASSERT_INT32_WITHIN(HOMING_VERIFY_TOLERANCE, -approach[axis], homing->getPosition(axis));
+}
+
+void test_stale_cache_is_caught() {
+    //Y was moved by hand a little, the touch lands outside the tolerance
+    const int32_t cached[AXIS_COUNT] = {AXIS_LENGTH / 2, AXIS_LENGTH / 2, AXIS_LENGTH / 2};
+    int32_t actual[AXIS_COUNT] = {AXIS_LENGTH / 2, AXIS_LENGTH / 2 - 20, AXIS_LENGTH / 2};
+    placeCarriages(actual);
+
+    int32_t approach[AXIS_COUNT];
+    TEST_ASSERT_TRUE(fastStart(cached, approach));
+    TEST_ASSERT_TRUE(abs(homing->getPosition(1) + approach[1]) > HOMING_VERIFY_TOLERANCE);
+
+    //Moved a long way, the switch isn't found within the budget at all
+    actual[1] = AXIS_LENGTH / 2 + 500;
+    placeCarriages(actual);
+    TEST_ASSERT_FALSE(fastStart(cached, approach));
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_full_home_from_centre);
+    RUN_TEST(test_cached_start_from_centre);
+    RUN_TEST(test_cached_start_from_inside_the_margin);
+    RUN_TEST(test_stale_cache_is_caught);
+    return UNITY_END();
+}
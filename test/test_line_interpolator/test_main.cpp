@@ -0,0 +1,114 @@
+#include <unity.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "LineInterpolator.h"
+
+//Steps the interpolator through whole lines and compares every event with the ideal line
+
+static LineInterpolator interpolator;
+
+//Run the line to the end, checking each axis stays within a step of the ideal line
+//and that the major axis steps on every event. Returns the largest error seen.
+static float runLine(const int32_t delta[AXIS_COUNT], int32_t position[AXIS_COUNT]) {
+    interpolator.begin(delta);
+
+    uint8_t major = 0;
+    for (uint8_t axis = 0; axis < AXIS_COUNT; axis++) {
+        position[axis] = 0;
+        if (abs(delta[axis]) > abs(delta[major]))
+            major = axis;
+    }
+
+    uint32_t events = interpolator.getEvents();
+    float worst = 0;
+    for (uint32_t event = 1; !interpolator.isDone(); event++) {
+        uint8_t mask = interpolator.next();
+        if (delta[major] != 0)
+            TEST_ASSERT_TRUE_MESSAGE(mask & (1 << major), "major axis skipped an event");
+
+        for (uint8_t axis = 0; axis < AXIS_COUNT; axis++) {
+            if (mask & (1 << axis))
+                position[axis] += interpolator.getForwardMask() & (1 << axis) ? 1 : -1;
+
+            float ideal = (float)delta[axis] * event / events;
+            float error = fabsf(position[axis] - ideal);
+            if (error > worst)
+                worst = error;
+        }
+    }
+    return worst;
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_endpoints_are_exact() {
+    const int32_t lines[][AXIS_COUNT] = {
+        {1, 0, 0}, {0, 0, 0}, {7, 3, 1}, {1000, 999, 1}, {12345, 6789, 101}, {3, 3, 3}, {65536, 1, 32768},
+    };
+
+    for (const int32_t *delta : lines) {
+        int32_t position[AXIS_COUNT];
+        runLine(delta, position);
+        for (uint8_t axis = 0; axis < AXIS_COUNT; axis++)
+            TEST_ASSERT_EQUAL_INT32(delta[axis], position[axis]);
+    }
+}
+
+void test_steps_follow_the_ideal_line() {
+    srand(1);
+    for (int i = 0; i < 200; i++) {
+        int32_t delta[AXIS_COUNT];
+        for (uint8_t axis = 0; axis < AXIS_COUNT; axis++)
+            delta[axis] = rand() % 4001 - 2000;
+
+        int32_t position[AXIS_COUNT];
+        float worst = runLine(delta, position);
+
+        //Minor axis steps land mid span, so they never stray more than half a step
+        TEST_ASSERT_TRUE(worst <= 0.5f + 0.001f);
+        for (uint8_t axis = 0; axis < AXIS_COUNT; axis++)
+            TEST_ASSERT_EQUAL_INT32(delta[axis], position[axis]);
+    }
+}
+
+void test_dominant_axis_switches() {
+    const int32_t lines[][AXIS_COUNT] = {{900, 100, 10}, {100, 900, 10}, {10, 100, 900}};
+
+    for (uint8_t major = 0; major < AXIS_COUNT; major++) {
+        int32_t position[AXIS_COUNT];
+        runLine(lines[major], position);
+        TEST_ASSERT_EQUAL_UINT32(900, interpolator.getEvents());
+        for (uint8_t axis = 0; axis < AXIS_COUNT; axis++)
+            TEST_ASSERT_EQUAL_INT32(lines[major][axis], position[axis]);
+    }
+}
+
+void test_negative_deltas() {
+    int32_t delta[AXIS_COUNT] = {-500, 250, -1};
+    int32_t position[AXIS_COUNT];
+    float worst = runLine(delta, position);
+
+    TEST_ASSERT_EQUAL_UINT8(1 << 1, interpolator.getForwardMask());
+    TEST_ASSERT_TRUE(worst <= 0.5f);
+    for (uint8_t axis = 0; axis < AXIS_COUNT; axis++)
+        TEST_ASSERT_EQUAL_INT32(delta[axis], position[axis]);
+
+    //A negative major axis still counts its magnitude in events
+    int32_t down[AXIS_COUNT] = {-30, -20, -10};
+    runLine(down, position);
+    TEST_ASSERT_EQUAL_UINT32(30, interpolator.getEvents());
+    TEST_ASSERT_EQUAL_UINT8(0, interpolator.getForwardMask());
+    for (uint8_t axis = 0; axis < AXIS_COUNT; axis++)
+        TEST_ASSERT_EQUAL_INT32(down[axis], position[axis]);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_endpoints_are_exact);
+    RUN_TEST(test_steps_follow_the_ideal_line);
+    RUN_TEST(test_dominant_axis_switches);
+    RUN_TEST(test_negative_deltas);
+    return UNITY_END();
+}
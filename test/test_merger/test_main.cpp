@@ -0,0 +1,211 @@
+#include <unity.h>
+#include <math.h>
+
+#include "SegmentMerger.h"
+
+//Feeds moves through the merger the way scrollToCoords() does and records what it queues
+
+#define MAX_LINES 64
+
+static SegmentMerger *merger;
+static int32_t lines[MAX_LINES][AXIS_COUNT];
+static float lineFeedRates[MAX_LINES];
+static uint8_t lineCount;
+static int32_t planned[AXIS_COUNT];
+
+static void queueHeld() {
+    int32_t target[AXIS_COUNT];
+    float feedRate;
+    if (!merger->take(target, feedRate))
+        return;
+
+    for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+        lines[lineCount][i] = target[i];
+        planned[i] = target[i];
+    }
+    lineFeedRates[lineCount++] = feedRate;
+}
+
+//What scrollToCoords() does with a target in steps, rounding onto whole steps like toSteps()
+static void moveTo(float x, float y, float z, float feedRate = 0) {
+    const float coords[AXIS_COUNT] = {x, y, z};
+    int32_t from[AXIS_COUNT];
+    int32_t target[AXIS_COUNT];
+    for (uint8_t i = 0; i < AXIS_COUNT; i++) {
+        from[i] = merger->isHolding() ? merger->getEnd(i) : planned[i];
+        target[i] = lroundf(coords[i]);
+    }
+
+    if (!merger->add(from, target, feedRate)) {
+        queueHeld();
+        merger->add(from, target, feedRate);
+    }
+}
+
+void setUp() {
+    merger = new SegmentMerger();
+    lineCount = 0;
+    for (uint8_t i = 0; i < AXIS_COUNT; i++)
+        planned[i] = 0;
+}
+
+void tearDown() {
+    delete merger;
+}
+
+void test_collinear_moves_merge() {
+    //40 micro-segments down one line only cost a queue slot per MERGE_MAX_MOVES of them
+    for (int n = 1; n <= 40; n++)
+        moveTo(3 * n, n, 0);
+    queueHeld();
+
+    TEST_ASSERT_EQUAL_UINT8(40 / MERGE_MAX_MOVES, lineCount);
+    TEST_ASSERT_EQUAL_INT32(120, lines[lineCount - 1][0]);
+    TEST_ASSERT_EQUAL_INT32(40, lines[lineCount - 1][1]);
+    for (uint8_t n = 0; n < lineCount; n++) {
+        TEST_ASSERT_EQUAL_INT32(3 * MERGE_MAX_MOVES * (n + 1), lines[n][0]);
+        TEST_ASSERT_EQUAL_INT32(MERGE_MAX_MOVES * (n + 1), lines[n][1]);
+    }
+    TEST_ASSERT_EQUAL_UINT32(40 - lineCount, merger->getMerged());
+    TEST_ASSERT_EQUAL_UINT32(0, merger->getFolded());
+}
+
+void test_bends_past_the_tolerance_stay_apart() {
+    //(10, 0) is 0.499 steps off the line to (20, 1), inside the default half a step
+    moveTo(10, 0, 0);
+    moveTo(20, 1, 0);
+    TEST_ASSERT_EQUAL_UINT8(0, lineCount);
+    TEST_ASSERT_EQUAL_UINT32(1, merger->getMerged());
+
+    //But it would be 0.995 off the line to (20, 2), so that's a move of its own
+    merger->cancel();
+    moveTo(10, 0, 0);
+    moveTo(20, 2, 0);
+    TEST_ASSERT_EQUAL_UINT8(1, lineCount);
+    TEST_ASSERT_EQUAL_INT32(10, lines[0][0]);
+    TEST_ASSERT_EQUAL_INT32(0, lines[0][1]);
+    TEST_ASSERT_EQUAL_INT32(20, merger->getEnd(0));
+    TEST_ASSERT_EQUAL_INT32(2, merger->getEnd(1));
+    TEST_ASSERT_EQUAL_UINT32(1, merger->getMerged());
+
+    //A tighter tolerance turns the first bend away too
+    merger->cancel();
+    lineCount = 0;
+    planned[0] = planned[1] = 0;
+    merger->setTolerance(0.25f);
+    moveTo(10, 0, 0);
+    moveTo(20, 1, 0);
+    TEST_ASSERT_EQUAL_UINT8(1, lineCount);
+}
+
+void test_curves_stay_within_tolerance() {
+    //Two 64th chords of a 200 step radius sag almost a step from the line across both, but the
+    //ends are rounded onto whole steps so some pairs come out straighter than that and merge
+    int32_t ends[64][2];
+    for (int n = 0; n < 64; n++) {
+        float angle = (n + 1) * 2 * (float)M_PI / 64;
+        moveTo(200 * cosf(angle) - 200, 200 * sinf(angle), 0);
+        ends[n][0] = lroundf(200 * cosf(angle) - 200);
+        ends[n][1] = lroundf(200 * sinf(angle));
+    }
+    queueHeld();
+    TEST_ASSERT_TRUE(lineCount < 64);
+    TEST_ASSERT_EQUAL_UINT32(64 - lineCount, merger->getMerged());
+
+    //Whatever merged, every chord end is still within the tolerance of the line that replaced it
+    int32_t from[2] = {0, 0};
+    int n = 0;
+    for (uint8_t k = 0; k < lineCount; k++) {
+        float dx = lines[k][0] - from[0];
+        float dy = lines[k][1] - from[1];
+        for (; n < 64; n++) {
+            float off = fabsf((ends[n][0] - from[0]) * dy - (ends[n][1] - from[1]) * dx) / sqrtf(dx * dx + dy * dy);
+            TEST_ASSERT_TRUE(off <= MERGE_TOLERANCE);
+            if (ends[n][0] == lines[k][0] && ends[n][1] == lines[k][1])
+                break;
+        }
+        n++;
+        from[0] = lines[k][0];
+        from[1] = lines[k][1];
+    }
+    TEST_ASSERT_EQUAL_INT(64, n);
+}
+
+void test_sub_step_moves_fold_into_the_next() {
+    //0.4 steps rounds back onto where it started, it takes no slot and its fraction carries on
+    moveTo(0.4f, 0, 0);
+    TEST_ASSERT_FALSE(merger->isHolding());
+    TEST_ASSERT_EQUAL_UINT32(1, merger->getFolded());
+
+    //Another 0.4 makes 0.8, which rounds onto the next step
+    moveTo(0.8f, 0, 0);
+    TEST_ASSERT_TRUE(merger->isHolding());
+    TEST_ASSERT_EQUAL_INT32(1, merger->getEnd(0));
+
+    //Short moves past a held one fold too, and don't disturb it
+    moveTo(1.2f, 0.3f, 0);
+    TEST_ASSERT_EQUAL_UINT32(2, merger->getFolded());
+    TEST_ASSERT_EQUAL_INT32(1, merger->getEnd(0));
+    TEST_ASSERT_EQUAL_UINT32(0, merger->getMerged());
+
+    queueHeld();
+    TEST_ASSERT_EQUAL_UINT8(1, lineCount);
+    TEST_ASSERT_EQUAL_INT32(1, lines[0][0]);
+}
+
+void test_reversals_are_not_merged() {
+    //Straight back along the same line is well within tolerance of it, but it's another move
+    moveTo(10, 0, 0);
+    moveTo(5, 0, 0);
+    TEST_ASSERT_EQUAL_UINT8(1, lineCount);
+    TEST_ASSERT_EQUAL_INT32(10, lines[0][0]);
+    TEST_ASSERT_EQUAL_INT32(5, merger->getEnd(0));
+    TEST_ASSERT_EQUAL_UINT32(0, merger->getMerged());
+
+    //Carrying on the new way merges as usual
+    moveTo(0, 0, 0);
+    TEST_ASSERT_EQUAL_UINT8(1, lineCount);
+    TEST_ASSERT_EQUAL_UINT32(1, merger->getMerged());
+}
+
+void test_feed_rate_changes_are_not_merged() {
+    moveTo(10, 0, 0, 20);
+    moveTo(20, 0, 0, 40);
+    TEST_ASSERT_EQUAL_UINT8(1, lineCount);
+    TEST_ASSERT_EQUAL_FLOAT(20, lineFeedRates[0]);
+    TEST_ASSERT_EQUAL_UINT32(0, merger->getMerged());
+}
+
+void test_counters_add_up() {
+    //3 merges, then a fold, a bend that starts a new line, and another merge and fold on it
+    moveTo(10, 0, 0);
+    moveTo(20, 0, 0);
+    moveTo(30, 0, 0);
+    moveTo(40, 0, 0);
+    moveTo(40.2f, 0, 0);
+    moveTo(40, 10, 0);
+    moveTo(40, 20, 0);
+    moveTo(40, 20.4f, 0);
+    queueHeld();
+
+    TEST_ASSERT_EQUAL_UINT8(2, lineCount);
+    TEST_ASSERT_EQUAL_UINT32(4, merger->getMerged());
+    TEST_ASSERT_EQUAL_UINT32(2, merger->getFolded());
+
+    //Nothing is held afterwards, so counts stay put
+    TEST_ASSERT_FALSE(merger->isHolding());
+    queueHeld();
+    TEST_ASSERT_EQUAL_UINT8(2, lineCount);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_collinear_moves_merge);
+    RUN_TEST(test_bends_past_the_tolerance_stay_apart);
+    RUN_TEST(test_curves_stay_within_tolerance);
+    RUN_TEST(test_sub_step_moves_fold_into_the_next);
+    RUN_TEST(test_reversals_are_not_merged);
+    RUN_TEST(test_feed_rate_changes_are_not_merged);
+    RUN_TEST(test_counters_add_up);
+    return UNITY_END();
+}
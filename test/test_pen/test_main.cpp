@@ -0,0 +1,154 @@
+#include <unity.h>
+
+#include "StepScheduler.h"
+#include "PenFollower.h"
+
+/*
+ * A pen following the scheduler the way the motion task drives it, every
+ * control interval in virtual time, through drawing moves and the travel
+ * between them.
+ */
+
+#define CONTROL_INTERVAL_MS 20
+#define STEPS_PER_MM 100
+#define DRAW_SPEED 2000     //steps/s, 20 mm/s
+#define DRAW_ACCELERATION 20000
+//The time to change is estimated ignoring ramps, so it can be out by up to a ramp's length
+#define RAMP_MS (1000 * DRAW_SPEED / DRAW_ACCELERATION)
+#define MAX_EVENTS 8
+
+static StepScheduler *scheduler;
+static PenFollower follower;
+
+//What the pen did over a run, as times in ms
+struct Trace {
+    uint32_t feeds = 0;               //Intervals spent feeding
+    uint32_t retracts = 0;            //Intervals spent retracting
+    uint32_t feedStarts[MAX_EVENTS];  //When the pen went from anything else to feeding
+    uint32_t retractStarts[MAX_EVENTS];
+    uint32_t toolChanges[MAX_EVENTS]; //When the line being stepped changed tool state, going idle included
+    uint8_t feedCount = 0;
+    uint8_t retractCount = 0;
+    uint8_t changeCount = 0;
+    uint32_t end = 0;                 //When the scheduler went idle
+};
+
+static void record(uint32_t *times, uint8_t &count, uint32_t now) {
+    TEST_ASSERT_TRUE(count < MAX_EVENTS);
+    times[count++] = now;
+}
+
+//Step the scheduler a control interval at a time, following it, until it's idle and the pen has settled
+static void follow(Trace &trace) {
+    PenAction last = PEN_HOLD;
+    bool toolOn = false;
+    for (uint32_t now = CONTROL_INTERVAL_MS; scheduler->isBusy() || !follower.isSettled(); now += CONTROL_INTERVAL_MS) {
+        TEST_ASSERT_TRUE(now < 60000);
+        scheduler->run(CONTROL_INTERVAL_MS * 1000);
+
+        float velocity = scheduler->getVelocity(0) / STEPS_PER_MM;
+        uint32_t untilChange = scheduler->getTimeToToolChange(follower.getHorizon());
+        PenAction action = follower.follow(now, velocity, scheduler->isToolOn(), untilChange);
+
+        if (action == PEN_FEED) {
+            trace.feeds++;
+            if (last != PEN_FEED)
+                record(trace.feedStarts, trace.feedCount, now);
+        } else if (action == PEN_RETRACT) {
+            trace.retracts++;
+            if (last != PEN_RETRACT)
+                record(trace.retractStarts, trace.retractCount, now);
+        }
+        last = action;
+
+        if (scheduler->isToolOn() != toolOn) {
+            toolOn = !toolOn;
+            record(trace.toolChanges, trace.changeCount, now);
+        }
+
+        if (!scheduler->isBusy() && trace.end == 0)
+            trace.end = now;
+    }
+}
+
+//The pen reacted to a tool change at 'change' no earlier than leadTime ahead of it, give or take a ramp
+static void assertLeads(uint32_t change, uint32_t reaction) {
+    TEST_ASSERT_TRUE(reaction <= change);
+    TEST_ASSERT_TRUE(reaction + follower.leadTime + RAMP_MS + CONTROL_INTERVAL_MS >= change);
+}
+
+void setUp() {
+    scheduler = new StepScheduler();
+    for (uint8_t axis = 0; axis < AXIS_COUNT; axis++)
+        scheduler->setLimits(axis, DRAW_SPEED, DRAW_ACCELERATION);
+    follower = PenFollower();
+}
+
+void tearDown() {
+    delete scheduler;
+}
+
+void test_no_change_within_horizon_is_distinguishable() {
+    int32_t delta[AXIS_COUNT] = {20000, 0, 0};
+    scheduler->queueLine(delta, 0, true);
+    scheduler->run(2000000);
+
+    //8 s left on a line that extrudes, nothing is about to change
+    TEST_ASSERT_TRUE(scheduler->isToolOn());
+    TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, scheduler->getTimeToToolChange(follower.getHorizon()));
+
+    //Running out of moves is a change, once it's within the horizon
+    scheduler->run(7600000);
+    uint32_t untilChange = scheduler->getTimeToToolChange(follower.getHorizon());
+    TEST_ASSERT_UINT32_WITHIN(RAMP_MS * 1000, 400000, untilChange);
+}
+
+void test_long_draw_extrudes_then_retracts_at_its_end() {
+    //10 s of drawing
+    int32_t delta[AXIS_COUNT] = {20000, 0, 0};
+    scheduler->queueLine(delta, 0, true);
+
+    Trace trace;
+    follow(trace);
+    TEST_ASSERT_TRUE(trace.end > 9000);
+
+    //Feeding from the start straight through the middle, not retracting and priming over and over
+    TEST_ASSERT_EQUAL_UINT8(1, trace.feedCount);
+    TEST_ASSERT_EQUAL_UINT32(CONTROL_INTERVAL_MS, trace.feedStarts[0]);
+
+    //The one retract starts within leadTime of the end and lasts leadTime
+    TEST_ASSERT_EQUAL_UINT8(1, trace.retractCount);
+    assertLeads(trace.end, trace.retractStarts[0]);
+    TEST_ASSERT_UINT32_WITHIN(1, follower.leadTime / CONTROL_INTERVAL_MS, trace.retracts);
+}
+
+void test_travel_between_strokes() {
+    //Draw, travel, draw, 2 s each
+    int32_t draw[AXIS_COUNT] = {4000, 0, 0};
+    int32_t travel[AXIS_COUNT] = {0, 4000, 0};
+    scheduler->queueLine(draw, DRAW_SPEED, true);
+    scheduler->queueLine(travel, DRAW_SPEED, false);
+    scheduler->queueLine(draw, DRAW_SPEED, true);
+
+    Trace trace;
+    follow(trace);
+
+    //On, off for the travel, on again and off at the end
+    TEST_ASSERT_EQUAL_UINT8(4, trace.changeCount);
+
+    //Pulled back ahead of the travel and of the end, primed ahead of the second stroke
+    TEST_ASSERT_EQUAL_UINT8(2, trace.retractCount);
+    assertLeads(trace.toolChanges[1], trace.retractStarts[0]);
+    assertLeads(trace.toolChanges[3], trace.retractStarts[1]);
+
+    TEST_ASSERT_EQUAL_UINT8(2, trace.feedCount);
+    assertLeads(trace.toolChanges[2], trace.feedStarts[1]);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_no_change_within_horizon_is_distinguishable);
+    RUN_TEST(test_long_draw_extrudes_then_retracts_at_its_end);
+    RUN_TEST(test_travel_between_strokes);
+    return UNITY_END();
+}
@@ -0,0 +1,98 @@
+#include <unity.h>
+#include <stdio.h>
+#include <chrono>
+
+#include "SCurveProfile.h"
+#include "TrapezoidProfile.h"
+
+//Step timing of both profiles, and what each costs against the other on the host
+
+#define BENCH_STEPS 20000
+#define BENCH_MOVES 50
+
+static SCurveProfile sCurve;
+static TrapezoidProfile trapezoid;
+
+void setUp() {}
+void tearDown() {}
+
+void test_scurve_slow_cruise_keeps_its_speed() {
+    //5 steps/s is 200000 us a step, well past the 144 ms the first step from standstill takes at this jerk
+    sCurve.begin(20, 5, 5, 5, 1000, 2000);
+    for (int i = 0; i < 20; i++)
+        TEST_ASSERT_UINT32_WITHIN(1000, 200000, sCurve.next());
+
+    //Ramping up from standstill into the same cruise, only the first step may be capped
+    sCurve.begin(40, 0, 5, 0, 1000, 2000);
+    uint32_t total = 0;
+    for (int i = 0; i < 40; i++) {
+        uint32_t interval = sCurve.next();
+        TEST_ASSERT_TRUE(interval <= 200000 + 1000);
+        total += interval;
+    }
+    TEST_ASSERT_UINT32_WITHIN(1000000, 40 * 200000, total);
+}
+
+void test_scurve_fast_cruise_unchanged() {
+    sCurve.begin(5000, 0, 1000, 0, 10000, 200000);
+    uint32_t cruise = 0;
+    for (uint32_t i = 0; i < 5000; i++) {
+        uint32_t interval = sCurve.next();
+        if (i == 2500)
+            cruise = interval;
+    }
+    TEST_ASSERT_UINT32_WITHIN(2, 1000, cruise);
+}
+
+static void planSCurve(SCurveProfile &p) { p.begin(BENCH_STEPS, 0, 4000, 0, 2000, 20000); }
+static void planTrapezoid(TrapezoidProfile &p) { p.begin(BENCH_STEPS, 0, 4000, 0, 2000); }
+
+template <typename Profile> static double nsPerStep(Profile &profile, void (*plan)(Profile &)) {
+    volatile uint32_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int move = 0; move < BENCH_MOVES; move++) {
+        plan(profile);
+        for (uint32_t i = 0; i < BENCH_STEPS; i++)
+            sink += profile.next();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    (void)sink;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / ((double)BENCH_STEPS * BENCH_MOVES);
+}
+
+//How long the move takes on the machine, every step's interval added up
+template <typename Profile> static double moveSeconds(Profile &profile, void (*plan)(Profile &)) {
+    plan(profile);
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < BENCH_STEPS; i++)
+        total += profile.next();
+    return total / 1e6;
+}
+
+void test_cost_against_trapezoid() {
+    //The same move both ways, long enough to be mostly ramps and cruise in equal measure
+    double sCurveNs = nsPerStep<SCurveProfile>(sCurve, planSCurve);
+    double trapezoidNs = nsPerStep<TrapezoidProfile>(trapezoid, planTrapezoid);
+    double sCurveTime = moveSeconds<SCurveProfile>(sCurve, planSCurve);
+    double trapezoidTime = moveSeconds<TrapezoidProfile>(trapezoid, planTrapezoid);
+
+    char report[160];
+    snprintf(report, sizeof(report), "per step: s-curve %.1f ns, trapezoid %.1f ns (%.2fx)", sCurveNs, trapezoidNs, sCurveNs / trapezoidNs);
+    TEST_MESSAGE(report);
+    snprintf(report, sizeof(report), "move time: s-curve %.3f s, trapezoid %.3f s (%+.1f%%)", sCurveTime, trapezoidTime, (sCurveTime / trapezoidTime - 1) * 100);
+    TEST_MESSAGE(report);
+
+    //2 s up to 4000 steps/s over 4000 steps, 3 s cruising the middle 12000 and 2 s back down
+    TEST_ASSERT_FLOAT_WITHIN(0.07f, 7.0f, (float)trapezoidTime);
+    //Limiting jerk only ever rounds the corners off, it can't get there sooner
+    TEST_ASSERT_TRUE(sCurveTime >= trapezoidTime);
+    TEST_ASSERT_TRUE(sCurveTime < trapezoidTime * 1.1);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_scurve_slow_cruise_keeps_its_speed);
+    RUN_TEST(test_scurve_fast_cruise_unchanged);
+    RUN_TEST(test_cost_against_trapezoid);
+    return UNITY_END();
+}
@@ -0,0 +1,109 @@
+#include <unity.h>
+#include <stdio.h>
+#include <math.h>
+#include <chrono>
+
+#include <StepperRamp.h>
+
+/*
+ * StepperRamp against the AVR446 recurrence c[n] = c[n-1] * (4n - 1) / (4n + 1)
+ * worked out exactly in doubles. Intervals come out rounded to the us, so half
+ * a us either way isn't counted as error. Ramps are followed down to 50 us a
+ * step, 20 kHz, past anything the printer asks of them.
+ */
+
+#define SHORTEST_INTERVAL 50
+#define BENCH_STEPS 1000000
+
+static const float accelerations[] = {20, 200, 2000, 20000, 200000};
+
+//Relative error of an interval, not counting the rounding to whole us
+static double errorOf(uint32_t interval, double exact) {
+    return fmax(0, fabs(interval - exact) - 0.5) / exact;
+}
+
+//Worst error over the first steps of every ramp, accelerating and then decelerating back down
+static void worstErrors(uint32_t steps, double &accelerating, double &decelerating) {
+    accelerating = decelerating = 0;
+    for (float acceleration : accelerations) {
+        StepperRamp ramp;
+        ramp.begin(acceleration);
+
+        double exact = 0.676 * sqrt(2.0 / acceleration) * 1000000.0;
+        uint32_t n = 0;
+        while (n < steps) {
+            ramp.accelerate();
+            n++;
+            exact = exact * (4.0 * n - 1) / (4.0 * n + 1);
+            if (exact < SHORTEST_INTERVAL)
+                break;
+
+            accelerating = fmax(accelerating, errorOf(ramp.interval(), exact));
+        }
+
+        //Back down the same ramp, the error on the way up isn't undone so this is the round trip's
+        while (n > 1) {
+            ramp.decelerate();
+            exact = exact * (4.0 * n + 1) / (4.0 * n - 1);
+            n--;
+
+            decelerating = fmax(decelerating, errorOf(ramp.interval(), exact));
+        }
+    }
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_error_against_exact_profile() {
+    //The bounds StepperRamp.h quotes, with a little headroom
+    const uint32_t lengths[] = {16384, 65536, 131072};
+    const double accelBounds[] = {0.0025, 0.004, 0.02};
+    const double decelBounds[] = {0.006, 0.008, 0.02};
+
+    for (int i = 0; i < 3; i++) {
+        double accelerating, decelerating;
+        worstErrors(lengths[i], accelerating, decelerating);
+
+        char report[112];
+        snprintf(report, sizeof(report), "first %lu steps: worst error %.3f%% accelerating, %.3f%% back down",
+                 (unsigned long)lengths[i], accelerating * 100, decelerating * 100);
+        TEST_MESSAGE(report);
+        TEST_ASSERT_TRUE_MESSAGE(accelerating < accelBounds[i], report);
+        TEST_ASSERT_TRUE_MESSAGE(decelerating < decelBounds[i], report);
+    }
+}
+
+void test_per_step_cost() {
+    volatile uint32_t sink = 0;
+
+    StepperRamp ramp;
+    ramp.begin(2000);
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t n = 0; n < BENCH_STEPS; n++) {
+        ramp.accelerate();
+        sink += ramp.interval();
+    }
+    double rampNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / BENCH_STEPS;
+
+    //The recurrence done directly in float, a divide per step
+    float interval = 0.676f * sqrtf(2.0f / 2000) * 1000000.0f;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t n = 1; n <= BENCH_STEPS; n++) {
+        interval -= 2 * interval / (4 * n + 1);
+        sink += (uint32_t)(interval + 0.5f);
+    }
+    double floatNs = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / BENCH_STEPS;
+    (void)sink;
+
+    char report[96];
+    snprintf(report, sizeof(report), "per step: StepperRamp %.2f ns, float recurrence %.2f ns", rampNs, floatNs);
+    TEST_MESSAGE(report);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_error_against_exact_profile);
+    RUN_TEST(test_per_step_cost);
+    return UNITY_END();
+}
@@ -0,0 +1,206 @@
+#include <unity.h>
+
+#include "StepScheduler.h"
+
+//Drives the scheduler from virtual time with run() and checks what it steps
+
+static StepScheduler *scheduler;
+static int32_t stepped[AXIS_COUNT];
+static uint32_t lastStep[AXIS_COUNT];
+static uint32_t shortestGap[AXIS_COUNT];
+static bool released[AXIS_COUNT];
+static uint32_t wokenAt[AXIS_COUNT];
+
+//Every X step, signed by direction and timed
+#define MAX_TRACE 2000
+static int32_t traceDirections[MAX_TRACE];
+static uint32_t traceTimes[MAX_TRACE];
+static uint16_t traceLength;
+
+static bool onStep(uint8_t axis, bool forward) {
+    //Like a motor whose coils were let go, the first step only wakes it
+    if (released[axis]) {
+        released[axis] = false;
+        wokenAt[axis] = scheduler->now();
+        return false;
+    }
+
+    stepped[axis] += forward ? 1 : -1;
+    if (axis == 0 && traceLength < MAX_TRACE) {
+        traceDirections[traceLength] = forward ? 1 : -1;
+        traceTimes[traceLength++] = scheduler->now();
+    }
+
+    uint32_t now = scheduler->now();
+    if (lastStep[axis] != 0 && now - lastStep[axis] < shortestGap[axis])
+        shortestGap[axis] = now - lastStep[axis];
+    lastStep[axis] = now;
+    return true;
+}
+
+//Run until the scheduler goes idle, giving up after timeoutUs
+static bool runUntilIdle(uint32_t timeoutUs) {
+    uint32_t start = scheduler->now();
+    while (scheduler->isBusy()) {
+        if (scheduler->now() - start > timeoutUs)
+            return false;
+
+        scheduler->run(1000);
+    }
+    return true;
+}
+
+void setUp() {
+    scheduler = new StepScheduler();
+    scheduler->attach(onStep);
+    for (uint8_t axis = 0; axis < AXIS_COUNT; axis++) {
+        scheduler->setLimits(axis, 1000, 10000);
+        stepped[axis] = 0;
+        lastStep[axis] = 0;
+        shortestGap[axis] = UINT32_MAX;
+        released[axis] = false;
+    }
+    traceLength = 0;
+}
+
+void tearDown() {
+    delete scheduler;
+}
+
+void test_line_lands_on_target() {
+    int32_t delta[AXIS_COUNT] = {1000, -400, 7};
+    TEST_ASSERT_TRUE(scheduler->queueLine(delta));
+    TEST_ASSERT_TRUE(runUntilIdle(5000000));
+
+    for (uint8_t axis = 0; axis < AXIS_COUNT; axis++) {
+        TEST_ASSERT_EQUAL_INT32(delta[axis], stepped[axis]);
+        TEST_ASSERT_EQUAL_INT32(delta[axis], scheduler->getPosition(axis));
+    }
+}
+
+void test_line_takes_its_ramped_time() {
+    //50 steps up to 1000 steps/s in 0.1 s, 1900 at speed and 50 back down, 2.1 s in all
+    int32_t delta[AXIS_COUNT] = {2000, 0, 0};
+    scheduler->queueLine(delta);
+    TEST_ASSERT_TRUE(runUntilIdle(5000000));
+    TEST_ASSERT_UINT32_WITHIN(20000, 2100000, lastStep[0]);
+}
+
+void test_steps_respect_max_velocity() {
+    int32_t delta[AXIS_COUNT] = {3000, 1500, 0};
+    scheduler->queueLine(delta);
+    TEST_ASSERT_TRUE(runUntilIdle(10000000));
+
+    //1000 steps/s is 1000 us between steps, give or take a tick of quantization
+    TEST_ASSERT_GREATER_OR_EQUAL(1000 - STEP_TICK_US, shortestGap[0]);
+    TEST_ASSERT_GREATER_OR_EQUAL(2000 - STEP_TICK_US, shortestGap[1]);
+}
+
+void test_queued_lines_run_back_to_back() {
+    int32_t out[AXIS_COUNT] = {500, 500, 0};
+    int32_t back[AXIS_COUNT] = {-500, 0, 0};
+    TEST_ASSERT_TRUE(scheduler->queueLine(out));
+    TEST_ASSERT_TRUE(scheduler->queueLine(back));
+    TEST_ASSERT_EQUAL_INT32(0, scheduler->getPlannedPosition(0));
+    TEST_ASSERT_EQUAL_INT32(500, scheduler->getPlannedPosition(1));
+
+    TEST_ASSERT_TRUE(runUntilIdle(5000000));
+    TEST_ASSERT_EQUAL_INT32(0, scheduler->getPosition(0));
+    TEST_ASSERT_EQUAL_INT32(500, scheduler->getPosition(1));
+    TEST_ASSERT_EQUAL_INT32(0, scheduler->getQueueDepth());
+}
+
+void test_stop_drops_everything() {
+    int32_t delta[AXIS_COUNT] = {5000, 0, 0};
+    scheduler->queueLine(delta);
+    scheduler->queueLine(delta);
+    scheduler->run(200000);
+    TEST_ASSERT_TRUE(scheduler->isBusy());
+
+    scheduler->stop();
+    TEST_ASSERT_FALSE(scheduler->isBusy());
+
+    int32_t stoppedAt = scheduler->getPosition(0);
+    scheduler->run(200000);
+    TEST_ASSERT_EQUAL_INT32(stoppedAt, scheduler->getPosition(0));
+    TEST_ASSERT_EQUAL_INT32(stoppedAt, stepped[0]);
+}
+
+void test_set_position_moves_the_origin() {
+    int32_t delta[AXIS_COUNT] = {-100, 0, 0};
+    scheduler->setPosition(0, 250);
+    scheduler->queueLine(delta);
+    TEST_ASSERT_TRUE(runUntilIdle(5000000));
+    TEST_ASSERT_EQUAL_INT32(150, scheduler->getPosition(0));
+}
+
+void test_released_motor_steps_a_tick_after_waking() {
+    int32_t delta[AXIS_COUNT] = {200, 100, 0};
+    released[0] = true;
+    TEST_ASSERT_TRUE(scheduler->queueLine(delta));
+    TEST_ASSERT_TRUE(runUntilIdle(5000000));
+
+    //X's first step was held back a tick, and then no step was lost
+    TEST_ASSERT_EQUAL_UINT32(STEP_TICK_US, wokenAt[0]);
+    TEST_ASSERT_EQUAL_INT32(200, stepped[0]);
+    TEST_ASSERT_EQUAL_INT32(100, stepped[1]);
+    TEST_ASSERT_EQUAL_INT32(200, scheduler->getShapedPosition(0));
+    TEST_ASSERT_GREATER_OR_EQUAL(1000 - STEP_TICK_US, shortestGap[0]);
+}
+
+void test_backlash_keeps_the_axis_rate() {
+    scheduler->setBacklash(0, 10);
+    scheduler->setDirection(0, true);
+    int32_t out[AXIS_COUNT] = {300, 0, 0};
+    int32_t back[AXIS_COUNT] = {-300, 0, 0};
+    scheduler->queueLine(out);
+    scheduler->queueLine(back);
+    TEST_ASSERT_TRUE(runUntilIdle(5000000));
+    scheduler->run(100000);
+
+    //The take-up steps went to the motor and not to the position
+    TEST_ASSERT_EQUAL_INT32(0, scheduler->getPosition(0));
+    TEST_ASSERT_EQUAL_INT32(-10, stepped[0]);
+
+    //Nothing ever came faster than the axis' limit, a tick of quantization aside
+    TEST_ASSERT_GREATER_OR_EQUAL(1000 - STEP_TICK_US, shortestGap[0]);
+
+    uint16_t reversal = 0;
+    while (reversal < traceLength && traceDirections[reversal] > 0)
+        reversal++;
+    TEST_ASSERT_EQUAL_UINT16(300, reversal);
+
+    //The path starts back from rest at the reversal. The 10 take-up steps after its first step
+    //follow it up from there, rather than going out at the limit while the path crawls.
+    for (uint16_t i = reversal + 1; i <= reversal + 10; i++) {
+        TEST_ASSERT_EQUAL_INT32(-1, traceDirections[i]);
+        TEST_ASSERT_GREATER_OR_EQUAL(2000, traceTimes[i] - traceTimes[i - 1]);
+    }
+}
+
+void test_feed_override_clamps() {
+    scheduler->setFeedOverride(150);
+    TEST_ASSERT_EQUAL_INT32(150, scheduler->getFeedOverride());
+
+    //Out of range requests clamp to the nearest end, rather than wrapping on the way in
+    scheduler->setFeedOverride(65600);
+    TEST_ASSERT_EQUAL_INT32(FEED_OVERRIDE_MAX, scheduler->getFeedOverride());
+    scheduler->setFeedOverride(-5);
+    TEST_ASSERT_EQUAL_INT32(FEED_OVERRIDE_MIN, scheduler->getFeedOverride());
+    scheduler->setFeedOverride(INT32_MAX);
+    TEST_ASSERT_EQUAL_INT32(FEED_OVERRIDE_MAX, scheduler->getFeedOverride());
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_line_lands_on_target);
+    RUN_TEST(test_line_takes_its_ramped_time);
+    RUN_TEST(test_steps_respect_max_velocity);
+    RUN_TEST(test_queued_lines_run_back_to_back);
+    RUN_TEST(test_stop_drops_everything);
+    RUN_TEST(test_set_position_moves_the_origin);
+    RUN_TEST(test_released_motor_steps_a_tick_after_waking);
+    RUN_TEST(test_backlash_keeps_the_axis_rate);
+    RUN_TEST(test_feed_override_clamps);
+    return UNITY_END();
+}
@@ -0,0 +1,135 @@
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "StepScheduler.h"
+
+/*
+ * Runs a fast X move through the scheduler and drives a damped spring, the
+ * frame, with the steps it emits. The ringing left once the move is done is
+ * compared with and without each shaper tuned to the spring's frequency.
+ *
+ * Set SHAPER_DUMP to a file name to get the planned and emitted positions and
+ * the frame's response as CSV, a column set per shaper, every millisecond.
+ */
+
+#define FRAME_FREQUENCY 40.0f
+#define FRAME_DAMPING 0.05f
+#define SHAPER_DAMPING 0.1f
+#define MOVE_STEPS 2000
+#define MOVE_ACCELERATION 300000
+#define SIMULATED_US 1500000
+#define DUMP_EVERY_US 1000
+#define DUMP_ROWS (SIMULATED_US / DUMP_EVERY_US)
+
+static const char *names[] = {"none", "zv", "zvd", "mzv"};
+
+//Position, shaped position and frame position per dumped row, per shaper
+static float curves[4][DUMP_ROWS][3];
+
+//Largest distance of the frame from the target once the move has finished stepping
+static double residual(ShaperType type, float frameFrequency) {
+    StepScheduler *scheduler = new StepScheduler();
+    for (uint8_t axis = 0; axis < AXIS_COUNT; axis++)
+        scheduler->setLimits(axis, 4000, MOVE_ACCELERATION);
+    if (type != SHAPER_NONE)
+        TEST_ASSERT_TRUE(scheduler->setShaper(0, type, FRAME_FREQUENCY, SHAPER_DAMPING));
+
+    int32_t delta[AXIS_COUNT] = {MOVE_STEPS, 0, 0};
+    scheduler->queueLine(delta);
+
+    //Semi-implicit Euler is plenty at 10 kHz against a 40 Hz spring
+    double omega = 2 * M_PI * frameFrequency;
+    double dt = STEP_TICK_US / 1000000.0;
+    double frame = 0;
+    double velocity = 0;
+    double worst = 0;
+    bool done = false;
+    for (uint32_t t = STEP_TICK_US; t <= SIMULATED_US; t += STEP_TICK_US) {
+        scheduler->run(STEP_TICK_US);
+        double drive = scheduler->getShapedPosition(0);
+        velocity += (-omega * omega * (frame - drive) - 2 * FRAME_DAMPING * omega * velocity) * dt;
+        frame += velocity * dt;
+
+        done = done || !scheduler->isBusy();
+        if (done)
+            worst = fmax(worst, fabs(frame - MOVE_STEPS));
+
+        if (t % DUMP_EVERY_US == 0) {
+            float *row = curves[type][t / DUMP_EVERY_US - 1];
+            row[0] = scheduler->getPosition(0);
+            row[1] = scheduler->getShapedPosition(0);
+            row[2] = frame;
+        }
+    }
+
+    TEST_ASSERT_TRUE(done);
+    TEST_ASSERT_EQUAL_INT32(MOVE_STEPS, scheduler->getShapedPosition(0));
+    delete scheduler;
+    return worst;
+}
+
+static void dumpCurves() {
+    const char *path = getenv("SHAPER_DUMP");
+    if (path == nullptr)
+        return;
+
+    FILE *file = fopen(path, "w");
+    TEST_ASSERT_TRUE_MESSAGE(file != nullptr, "couldn't write SHAPER_DUMP");
+
+    fprintf(file, "ms");
+    for (const char *name : names)
+        fprintf(file, ",%s_planned,%s_emitted,%s_frame", name, name, name);
+    fprintf(file, "\n");
+
+    for (int row = 0; row < DUMP_ROWS; row++) {
+        fprintf(file, "%d", (row + 1) * DUMP_EVERY_US / 1000);
+        for (int type = 0; type < 4; type++)
+            fprintf(file, ",%.0f,%.0f,%.3f", curves[type][row][0], curves[type][row][1], curves[type][row][2]);
+        fprintf(file, "\n");
+    }
+    fclose(file);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_residual_vibration_at_the_tuned_frequency() {
+    //How much of the unshaped ringing each shaper may leave
+    const double limits[] = {1, 0.15, 0.02, 0.15};
+
+    double unshaped = residual(SHAPER_NONE, FRAME_FREQUENCY);
+    TEST_ASSERT_TRUE_MESSAGE(unshaped > 1, "the move should set the frame ringing");
+
+    for (int type = SHAPER_ZV; type <= SHAPER_MZV; type++) {
+        double shaped = residual((ShaperType)type, FRAME_FREQUENCY);
+
+        char report[96];
+        snprintf(report, sizeof(report), "%s: residual %.3f steps against %.3f unshaped (%.1f%%)",
+                 names[type], shaped, unshaped, 100 * shaped / unshaped);
+        TEST_MESSAGE(report);
+        TEST_ASSERT_TRUE_MESSAGE(shaped < unshaped * limits[type], report);
+    }
+
+    dumpCurves();
+}
+
+void test_zvd_tolerates_frequency_error() {
+    //The frame rings 10% off what the shaper was tuned to
+    float frequency = FRAME_FREQUENCY * 1.1f;
+    double unshaped = residual(SHAPER_NONE, frequency);
+    double shaped = residual(SHAPER_ZVD, frequency);
+
+    char report[96];
+    snprintf(report, sizeof(report), "zvd 10%% off: residual %.3f steps against %.3f unshaped", shaped, unshaped);
+    TEST_MESSAGE(report);
+    TEST_ASSERT_TRUE_MESSAGE(shaped < unshaped * 0.1, report);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_residual_vibration_at_the_tuned_frequency);
+    RUN_TEST(test_zvd_tolerates_frequency_error);
+    return UNITY_END();
+}